@@ -0,0 +1,288 @@
+/*
+ * Microbenchmarks for FlashFairyPP on the host.
+ *
+ * Every store runs on a FlashSimulator and counts its operations, so next to the wall time per operation the
+ * benchmarks report the lines read, programmed lines, erases and the simulated flash time (STM32F1 latencies).
+ * Workloads use a fixed seed, so the flash figures are reproducible.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "FlashFairyPP/FlashFairyPP.h"
+#include "FlashSimulator.h"
+
+namespace FlashFairyPP {
+namespace {
+
+template <template <typename, typename, std::size_t, std::size_t, std::size_t> class Index>
+struct BenchTraits : public Traits<> {
+  using FlashHal = SimulatedFlashHal<>;
+
+  template <std::size_t NumPages>
+  using Statistics = ::FlashFairyPP::Statistics<NumPages>;
+
+  template <typename Key, typename Value, std::size_t NumIndexedKeys, std::size_t NumPages, std::size_t LinesPerPage>
+  using KeyIndex = Index<Key, Value, NumIndexedKeys, NumPages, LinesPerPage>;
+};
+
+/// Sparse keys up to the control keys, deduplicated with a SortedKeySet.
+struct LargeKeySpaceBenchTraits : public BenchTraits<NoIndex> {
+  constexpr static const std::size_t kNumKeys = 0xFFF0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+/// Keeps the compiler from dropping results.
+volatile uint32_t sink;
+
+/**
+ * \brief A FlashFairyPP on a fresh simulated flash.
+ */
+template <class FlashFairyT>
+class Bench {
+ public:
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  constexpr static const std::size_t kPageSize = FlashFairyT::Config_t::pageSize;
+  constexpr static const std::size_t kDataLines =
+      kPageSize / sizeof(typename FlashFairyT::FlashLine_t) - FlashFairyT::kPageHeaderLines;
+
+  Bench() : simulator_(memory_, kPageSize, FlashFairyT::kNumPages), random_(42) {
+    SimulatedFlashHal<>::simulator = &simulator_;
+    for (std::size_t i = 0; i < FlashFairyT::kNumPages; ++i) {
+      config_.pages[i] = reinterpret_cast<typename FlashFairyT::PagePtr_t>(simulator_.page(i));
+    }
+    flashFairy_.initialize(config_);
+  }
+
+  ~Bench() { SimulatedFlashHal<>::simulator = nullptr; }
+
+  FlashFairyT& flashFairy() { return flashFairy_; }
+  const typename FlashFairyT::Config_t& config() const { return config_; }
+  FlashSimulator& simulator() { return simulator_; }
+
+  key_type randomKey(const std::size_t numKeys) {
+    return static_cast<key_type>(std::uniform_int_distribution<std::size_t>(0, numKeys - 1)(random_));
+  }
+
+  value_type randomValue() {
+    return static_cast<value_type>(std::uniform_int_distribution<uint32_t>(0, FlashFairyT::kValueMask - 1)(random_));
+  }
+
+  /// Fill the active page up to fillPercent of its data lines, using keys below numKeys.
+  void fill(const std::size_t fillPercent, const std::size_t numKeys) {
+    const std::size_t numLines = kDataLines * fillPercent / 100;
+    for (std::size_t i = 0; i < numLines; ++i) {
+      flashFairy_.setValue(static_cast<key_type>(i % numKeys), static_cast<value_type>(i));
+    }
+  }
+
+ private:
+  alignas(8) uint8_t memory_[FlashFairyT::kNumPages * kPageSize];
+  FlashSimulator simulator_;
+  typename FlashFairyT::Config_t config_;
+  FlashFairyT flashFairy_;
+  std::mt19937 random_;
+};
+
+/**
+ * \brief Wall time and flash operations, accumulated over a number of operations.
+ */
+template <class FlashFairyT>
+class Cost {
+ public:
+  explicit Cost(Bench<FlashFairyT>& bench) : bench_(bench), simulator_(bench.simulator()) {}
+
+  void start() { start(bench_.flashFairy()); }
+  void stop() { stop(bench_.flashFairy()); }
+
+  /// Count the lines that flashFairy scans, e.g., an instance that is mounted on the pages of the bench.
+  void start(const FlashFairyT& flashFairy) {
+    reads_ -= flashFairy.getStatistics().numScannedLines;
+    programs_ -= simulator_.numPrograms();
+    erases_ -= simulator_.numErases();
+    flashNs_ -= simulator_.nowNs();
+    start_ = Clock::now();
+  }
+
+  void stop(const FlashFairyT& flashFairy) {
+    wall_ += Clock::now() - start_;
+    reads_ += flashFairy.getStatistics().numScannedLines;
+    programs_ += simulator_.numPrograms();
+    erases_ += simulator_.numErases();
+    flashNs_ += simulator_.nowNs();
+  }
+
+  void print(const char* name, const std::size_t numOperations) const {
+    const double n = static_cast<double>(numOperations);
+    printf("  %-32s %10.1f ns %9.1f reads %9.3f programs %9.5f erases %10.1f flash us\n", name,
+           static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(wall_).count()) / n,
+           static_cast<double>(reads_) / n, static_cast<double>(programs_) / n, static_cast<double>(erases_) / n,
+           static_cast<double>(flashNs_) / n / 1000.0);
+  }
+
+ private:
+  Bench<FlashFairyT>& bench_;
+  FlashSimulator& simulator_;
+  Clock::time_point start_;
+  Clock::duration wall_ = Clock::duration::zero();
+  std::size_t reads_ = 0;
+  std::size_t programs_ = 0;
+  std::size_t erases_ = 0;
+  uint64_t flashNs_ = 0;
+};
+
+/**
+ * \brief Runs operation numOperations times and prints the cost per operation.
+ */
+template <class FlashFairyT, class Operation>
+void measure(Bench<FlashFairyT>& bench, const char* name, const std::size_t numOperations, Operation operation) {
+  Cost<FlashFairyT> cost(bench);
+  cost.start();
+  for (std::size_t i = 0; i < numOperations; ++i) {
+    operation(i);
+  }
+  cost.stop();
+  cost.print(name, numOperations);
+}
+
+template <class FlashFairyT>
+void benchGetValue() {
+  constexpr static const std::size_t kNumLookups = 100000;
+  constexpr static const std::size_t kNumWrittenKeys = 64;
+  for (const std::size_t fillPercent : {0, 50, 100}) {
+    Bench<FlashFairyT> bench;
+    bench.fill(fillPercent, kNumWrittenKeys);
+    char name[64];
+    if (fillPercent > 0) {
+      snprintf(name, sizeof(name), "getValue hit, %zu%% fill", fillPercent);
+      measure(bench, name, kNumLookups, [&bench](std::size_t i) {
+        sink = bench.flashFairy().getValue(static_cast<typename FlashFairyT::key_type>(i % kNumWrittenKeys));
+      });
+    }
+    snprintf(name, sizeof(name), "getValue miss, %zu%% fill", fillPercent);
+    measure(bench, name, kNumLookups, [&bench](std::size_t i) {
+      sink = bench.flashFairy().getValue(static_cast<typename FlashFairyT::key_type>(kNumWrittenKeys + i % 64));
+    });
+  }
+}
+
+template <class FlashFairyT>
+void benchSetValue() {
+  constexpr static const std::size_t kNumWrites = 50000;
+  constexpr static const std::size_t kNumKeys = 200;
+  constexpr static const std::size_t kNumHotKeys = 8;
+  {
+    Bench<FlashFairyT> bench;
+    bench.fill(100, kNumKeys);
+    measure(bench, "setValue uniform", kNumWrites,
+            [&bench](std::size_t) { bench.flashFairy().setValue(bench.randomKey(kNumKeys), bench.randomValue()); });
+  }
+  {
+    // 90% of the writes go to a few hot keys.
+    Bench<FlashFairyT> bench;
+    bench.fill(100, kNumKeys);
+    measure(bench, "setValue skewed", kNumWrites, [&bench](std::size_t i) {
+      const std::size_t numKeys = (i % 10 == 0) ? kNumKeys : kNumHotKeys;
+      bench.flashFairy().setValue(bench.randomKey(numKeys), bench.randomValue());
+    });
+  }
+}
+
+template <class FlashFairyT>
+void benchSwitchPages() {
+  constexpr static const std::size_t kNumSwitches = 20;
+  constexpr static const typename FlashFairyT::key_type kHotKey = 250;
+  for (const std::size_t numLiveKeys : {0, 32, 64, 128, 200}) {
+    Bench<FlashFairyT> bench;
+    for (std::size_t key = 0; key < numLiveKeys; ++key) {
+      bench.flashFairy().setValue(static_cast<typename FlashFairyT::key_type>(key), bench.randomValue());
+    }
+    // Every measured write switches pages: the active page is filled up with the hot key before.
+    std::size_t numHotWrites = 0;
+    const auto fillActivePage = [&bench, &numHotWrites]() {
+      while (bench.flashFairy().numEntriesLeftOnActivePage() > 0) {
+        bench.flashFairy().setValue(kHotKey, static_cast<typename FlashFairyT::value_type>(numHotWrites++));
+      }
+    };
+    fillActivePage();
+
+    // Measure only the switching writes.
+    Cost<FlashFairyT> cost(bench);
+    for (std::size_t i = 0; i < kNumSwitches; ++i) {
+      cost.start();
+      bench.flashFairy().setValue(kHotKey, static_cast<typename FlashFairyT::value_type>(numHotWrites++));
+      cost.stop();
+      fillActivePage();
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "switchPages, %zu live keys", numLiveKeys);
+    cost.print(name, kNumSwitches);
+  }
+}
+
+template <class FlashFairyT>
+void benchInitialize() {
+  constexpr static const std::size_t kNumMounts = 200;
+  for (const std::size_t fillPercent : {0, 50, 100}) {
+    Bench<FlashFairyT> bench;
+    bench.fill(fillPercent, 200);
+    // Every mount uses a fresh instance, whose statistics only count the lines that initialize() scans.
+    Cost<FlashFairyT> cost(bench);
+    for (std::size_t i = 0; i < kNumMounts; ++i) {
+      FlashFairyT flashFairy;
+      cost.start(flashFairy);
+      flashFairy.initialize(bench.config());
+      cost.stop(flashFairy);
+      sink = static_cast<uint32_t>(flashFairy.numEntriesLeftOnActivePage());
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "initialize, %zu%% fill", fillPercent);
+    cost.print(name, kNumMounts);
+  }
+}
+
+template <class FlashFairyT>
+void benchLoadValues() {
+  constexpr static const std::size_t kNumRestores = 200;
+  constexpr static const std::size_t kNumKeys = FlashFairyT::kNumKeys;
+  Bench<FlashFairyT> bench;
+  bench.fill(100, 200);
+  typename FlashFairyT::value_type values[kNumKeys];
+  measure(bench, "restore all keys, getValue", kNumRestores, [&bench, &values](std::size_t) {
+    for (std::size_t key = 0; key < kNumKeys; ++key) {
+      bench.flashFairy().readValueIfAvailable(static_cast<typename FlashFairyT::key_type>(key), values[key]);
+    }
+    sink = values[0];
+  });
+  measure(bench, "restore all keys, loadValues", kNumRestores, [&bench, &values](std::size_t) {
+    typename FlashFairyT::KeyBitmap_t present;
+    sink = static_cast<uint32_t>(bench.flashFairy().loadValues(values, present));
+  });
+}
+
+template <class FlashFairyT>
+void benchAll(const char* name) {
+  printf("%s\n", name);
+  benchGetValue<FlashFairyT>();
+  benchSetValue<FlashFairyT>();
+  benchSwitchPages<FlashFairyT>();
+  benchInitialize<FlashFairyT>();
+  benchLoadValues<FlashFairyT>();
+}
+
+}  // namespace
+}  // namespace FlashFairyPP
+
+int main() {
+  using namespace FlashFairyPP;
+  benchAll<BasicFlashFairyPP<BenchTraits<NoIndex>>>("NoIndex");
+  benchAll<BasicFlashFairyPP<BenchTraits<PresenceHintIndex>>>("PresenceHintIndex");
+  benchAll<BasicFlashFairyPP<BenchTraits<ValueCacheIndex>>>("ValueCacheIndex");
+  printf("NoIndex, 16 bit key space\n");
+  benchSwitchPages<BasicFlashFairyPP<LargeKeySpaceBenchTraits>>();
+  return 0;
+}
@@ -12,13 +12,13 @@ class BitArray {
 
   constexpr static const auto kBitsPerElem = sizeof(StorageElement) * 8;
 
-  using Storage_t = StorageElement[lengthInBits / kBitsPerElem];
+  using Storage_t = StorageElement[(lengthInBits + kBitsPerElem - 1) / kBitsPerElem];
 
   void setBit(const StorageElement bit) { getElem(bit) |= getMask(bit); }
 
   void clearBit(const StorageElement bit) { getElem(bit) &= ~getMask(bit); }
 
-  bool isSet(const StorageElement bit) { return (getElem(bit) & getMask(bit)) != 0; }
+  bool isSet(const StorageElement bit) const { return (getElem(bit) & getMask(bit)) != 0; }
 
  private:
   Storage_t storage_;
@@ -28,6 +28,11 @@ class BitArray {
     return storage_[idx];
   }
 
+  const StorageElement& getElem(StorageElement bit) const {
+    const auto idx = getIdx(bit);
+    return storage_[idx];
+  }
+
   constexpr auto getIdx(StorageElement bit) const {
     const auto idx = bit / kBitsPerElem;
     return idx;
@@ -36,7 +41,7 @@ class BitArray {
   constexpr StorageElement getMask(StorageElement bit) const {
     const auto idx = getIdx(bit);
     const auto shift = bit - (idx * kBitsPerElem);
-    const StorageElement mask = 1 << shift;
+    const StorageElement mask = static_cast<StorageElement>(1) << shift;
     return mask;
   }
 };
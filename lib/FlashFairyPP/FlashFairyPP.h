@@ -3,46 +3,310 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
 
 #include "FlashFairyPP/BitArray.h"
+#include "FlashFairyPP/FlashHal.h"
+#include "FlashFairyPP/GcPolicy.h"
+#include "FlashFairyPP/KeyIndex.h"
+#include "FlashFairyPP/KeySet.h"
+#include "FlashFairyPP/ReadSync.h"
+#include "FlashFairyPP/Statistics.h"
 
-extern "C" {
-void FlashFairy_Erase_Page(void* pagePtr);
-void FlashFairy_Write_Word(void* pagePtr, uint32_t line);
-void flash_lock();
-void flash_unlock();
-}
+/*
+ * Flash backend, see FlashHal.h.
+ */
+#ifndef FLASHFAIRYPP_FLASH_HAL
+#define FLASHFAIRYPP_FLASH_HAL CFlashHal
+#endif
+
+/*
+ * Key index strategy, see KeyIndex.h. One of NoIndex, ValueCacheIndex or PresenceHintIndex.
+ */
+#ifndef FLASHFAIRYPP_KEY_INDEX
+#define FLASHFAIRYPP_KEY_INDEX NoIndex
+#endif
+
+/*
+ * Range of keys that are updated in place when a new value only clears bits, see Traits. Empty by default.
+ */
+#ifndef FLASHFAIRYPP_FIRST_IN_PLACE_KEY
+#define FLASHFAIRYPP_FIRST_IN_PLACE_KEY 0
+#endif
+#ifndef FLASHFAIRYPP_NUM_IN_PLACE_KEYS
+#define FLASHFAIRYPP_NUM_IN_PLACE_KEYS 0
+#endif
+
+/*
+ * Key set strategy for compaction and deduplicating reads, see KeySet.h. One of AutoKeySet, BitmapKeySet or
+ * SortedKeySet.
+ */
+#ifndef FLASHFAIRYPP_KEY_SET
+#define FLASHFAIRYPP_KEY_SET AutoKeySet
+#endif
+
+/*
+ * Statistics strategy, see Statistics.h. NoStatistics or Statistics.
+ */
+#ifndef FLASHFAIRYPP_STATISTICS
+#define FLASHFAIRYPP_STATISTICS NoStatistics
+#endif
+
+/*
+ * Trace hooks, see Statistics.h.
+ */
+#ifndef FLASHFAIRYPP_TRACE
+#define FLASHFAIRYPP_TRACE NoTrace
+#endif
+
+/*
+ * Garbage collection policy, see GcPolicy.h. NoGcPolicy, StaleRatioGcPolicy or FreeLinesGcPolicy.
+ */
+#ifndef FLASHFAIRYPP_GC_POLICY
+#define FLASHFAIRYPP_GC_POLICY NoGcPolicy
+#endif
+
+/*
+ * Read synchronization strategy, see ReadSync.h. NoReadSync or SeqLockReadSync.
+ */
+#ifndef FLASHFAIRYPP_READ_SYNC
+#define FLASHFAIRYPP_READ_SYNC NoReadSync
+#endif
+
+/*
+ * Number of flash pages that form the storage ring. At least two.
+ */
+#ifndef FLASHFAIRYPP_NUM_PAGES
+#define FLASHFAIRYPP_NUM_PAGES 2
+#endif
+
+/*
+ * Number of live entries that a single compaction step copies. 0 compacts synchronously when switching pages.
+ */
+#ifndef FLASHFAIRYPP_COMPACTION_STEP_ENTRIES
+#define FLASHFAIRYPP_COMPACTION_STEP_ENTRIES 0
+#endif
 
 namespace FlashFairyPP {
 
+/// Smallest unsigned type with at least Bits bits.
+template <unsigned Bits>
+using UintForBits_t = typename std::conditional<
+    (Bits <= 8), uint8_t,
+    typename std::conditional<(Bits <= 16), uint16_t,
+                              typename std::conditional<(Bits <= 32), uint32_t, uint64_t>::type>::type>::type;
+
+/**
+ * \brief Compile-time configuration of a BasicFlashFairyPP.
+ *
+ * Each line of flash stores a key in its upper and a value in its lower bits. A line is the unit in which flash is
+ * programmed, either a 32 bit word or a 64 bit double-word. Further settings can be changed by deriving from Traits
+ * and shadowing the respective member.
+ */
+template <std::size_t PageSize = 1024, std::size_t NumKeys = 256, unsigned KeyBits = 16, unsigned ValueBits = 16,
+          unsigned LineBits = 32>
+struct Traits {
+  constexpr static const std::size_t kPageSize = PageSize;
+  constexpr static const std::size_t kNumKeys = NumKeys;
+  constexpr static const unsigned kKeyBits = KeyBits;
+  constexpr static const unsigned kValueBits = ValueBits;
+
+  static_assert(LineBits == 32 || LineBits == 64, "Lines are either words or double-words");
+  using FlashLine_t = UintForBits_t<LineBits>;
+
+  /// Number of flash pages that form the storage ring.
+  constexpr static const std::size_t kNumPages = FLASHFAIRYPP_NUM_PAGES;
+
+  /// Number of live entries that a single compaction step copies, 0 for synchronous compaction.
+  constexpr static const std::size_t kCompactionStepEntries = FLASHFAIRYPP_COMPACTION_STEP_ENTRIES;
+
+  /// Flash backend, see FlashHal.h.
+  using FlashHal = FLASHFAIRYPP_FLASH_HAL;
+
+  /// Keys from kFirstInPlaceKey on, e.g., unary counters or flag sets, whose newest line on the active page is
+  /// programmed again if a new value only clears bits. Needs flash that allows programming a programmed line.
+  constexpr static const std::size_t kFirstInPlaceKey = FLASHFAIRYPP_FIRST_IN_PLACE_KEY;
+  constexpr static const std::size_t kNumInPlaceKeys = FLASHFAIRYPP_NUM_IN_PLACE_KEYS;
+
+  /// Key index strategy, see KeyIndex.h.
+  template <typename Key, typename Value, std::size_t NumIndexedKeys, std::size_t NumPages, std::size_t LinesPerPage>
+  using KeyIndex = FLASHFAIRYPP_KEY_INDEX<Key, Value, NumIndexedKeys, NumPages, LinesPerPage>;
+
+  /// Key set strategy, see KeySet.h.
+  template <typename Key, std::size_t NumSetKeys, std::size_t Capacity>
+  using KeySet = FLASHFAIRYPP_KEY_SET<Key, NumSetKeys, Capacity>;
+
+  /// Statistics strategy, see Statistics.h.
+  template <std::size_t NumPages>
+  using Statistics = FLASHFAIRYPP_STATISTICS<NumPages>;
+
+  /// Trace hooks, see Statistics.h.
+  using Trace = FLASHFAIRYPP_TRACE;
+
+  /// Read synchronization strategy, see ReadSync.h.
+  using ReadSync = FLASHFAIRYPP_READ_SYNC;
+
+  /// Garbage collection policy that poll() consults, see GcPolicy.h.
+  using GcPolicy = FLASHFAIRYPP_GC_POLICY;
+};
+
+/**
+ * \brief Traits for flash that is programmed in 64 bit double-words, e.g., STM32L4/G4.
+ *
+ * Every line spans a full programming unit, so ECC protected flash does not waste half of each programmed unit.
+ */
+template <std::size_t PageSize = 2048, std::size_t NumKeys = 256, unsigned KeyBits = 32, unsigned ValueBits = 32>
+using DoubleWordTraits = Traits<PageSize, NumKeys, KeyBits, ValueBits, 64>;
+
+/// A mask of the lowest bits bits of T.
+template <typename T>
+constexpr T LowBitMask(const unsigned bits) {
+  return (bits >= sizeof(T) * 8) ? static_cast<T>(~static_cast<T>(0))
+                                 : static_cast<T>((static_cast<T>(1) << bits) - 1);
+}
+
 /*
- * \brief Class FlashFairyPP
+ * \brief Class BasicFlashFairyPP
  */
-class FlashFairyPP {
+template <class TraitsT = Traits<>>
+class BasicFlashFairyPP {
  public:
-  using key_type = uint16_t;
-  using value_type = uint16_t;
+  constexpr static const unsigned kKeyBits = TraitsT::kKeyBits;
+  constexpr static const unsigned kValueBits = TraitsT::kValueBits;
+  using FlashLine_t = typename TraitsT::FlashLine_t;
+  static_assert(kKeyBits + kValueBits <= sizeof(FlashLine_t) * 8, "Key and value must fit into a line");
+
+  using key_type = UintForBits_t<kKeyBits>;
+  using value_type = UintForBits_t<kValueBits>;
 
-  using FlashLine_t = uint32_t;
   using PagePtr_t = FlashLine_t*;
   using LinePtr_t = FlashLine_t*;
 
-  constexpr static const size_t kNumKeys = 256;
-  constexpr static const FlashLine_t kFreePattern = 0xFFFFFFFF;
-  constexpr static const value_type npos = 0xCAFE;
+  constexpr static const key_type kKeyMask = LowBitMask<key_type>(kKeyBits);
+  constexpr static const value_type kValueMask = LowBitMask<value_type>(kValueBits);
+
+  constexpr static const size_t kNumKeys = TraitsT::kNumKeys;
+  constexpr static const FlashLine_t kFreePattern = static_cast<FlashLine_t>(~static_cast<FlashLine_t>(0));
+  constexpr static const value_type npos = static_cast<value_type>(0xCAFE & kValueMask);
+
+  /// Control lines use keys at the top of the key range. They are never reported as values.
+  constexpr static const key_type kFirstControlKey = kKeyMask - 0xF;
+  constexpr static const key_type kBatchBeginKey = kKeyMask - 1;
+  constexpr static const key_type kBatchCommitKey = kKeyMask - 2;
+  constexpr static const key_type kBatchAbortKey = kKeyMask - 3;
+  constexpr static const key_type kBatchPaddingKey = kKeyMask - 4;
+  /// Page header lines, see Config_t.
+  constexpr static const key_type kPageBeginKey = kKeyMask - 5;
+  constexpr static const key_type kPageActiveKey = kKeyMask - 6;
+  constexpr static const key_type kPageClosedKey = kKeyMask - 7;
+  static_assert(kKeyBits > 4, "Key range too small for control keys");
+  static_assert(kNumKeys <= kFirstControlKey, "Key range overlaps with control keys");
+
+  /**
+   * Records hold up to kMaxRecordSize bytes for a single key. A record is stored as payload lines followed by a trailer
+   * line that carries the key and the record size. Payload lines are tagged in their two most significant bits, so
+   * every reader can skip them without knowing where a record starts. A record without its trailer, e.g., after a power
+   * loss, is ignored. Records need lines without unused bits and a key range that leaves room for the trailer keys.
+   */
+  constexpr static const unsigned kLineBits = sizeof(FlashLine_t) * 8;
+  constexpr static const std::size_t kRecordBytesPerLine = (kLineBits - 8) / 8;
+  constexpr static const key_type kRecordKeyBase = static_cast<key_type>(static_cast<key_type>(3) << (kKeyBits - 2));
+  constexpr static const bool kRecordsSupported =
+      kKeyBits + kValueBits == kLineBits && kNumKeys <= static_cast<std::size_t>(kFirstControlKey - kRecordKeyBase);
+  constexpr static const std::size_t kMaxRecordSize =
+      (kValueMask < 64 * kRecordBytesPerLine) ? kValueMask : 64 * kRecordBytesPerLine;
+
+  /// LinePtr_t addresses whole lines, whatever their width.
+  constexpr static const std::size_t kPtrLineIncrement = 1;
 
-  constexpr static const std::size_t kPtrLineIncrement = sizeof(FlashLine_t) / 4;
-  static_assert(kPtrLineIncrement > 0, "FlashLine_t has insufficient size");
+  constexpr static const std::size_t kNumPages = TraitsT::kNumPages;
+  static_assert(kNumPages >= 2, "FlashFairyPP needs at least two pages");
+
+  constexpr static const std::size_t kPageHeaderLines = 3;
+
+  /**
+   * With incremental compaction, switching pages only starts to compact the oldest page. Each following write copies
+   * up to kCompactionStepEntries live entries from the oldest page to the active page, poll() does the same and finally
+   * erases the oldest page. Reads see the newest entries throughout.
+   *
+   * Worst case per setValue() (or setValues()/setRecord()): the entry itself plus kCompactionStepEntries copied
+   * entries are programmed, and no page is erased as long as poll() finished the pending compaction before the active
+   * page fills up. Otherwise the write finishes the compaction first, which programs the remaining live entries and
+   * erases one page. Switching pages scans the ring newest-first once to find the live entries of the oldest page.
+   * A step reads no other lines than those of the entries it copies, i.e., at most kCompactionStepEntries times the
+   * lines of the largest entry.
+   */
+  constexpr static const std::size_t kCompactionStepEntries = TraitsT::kCompactionStepEntries;
+  constexpr static const bool kIncrementalCompaction = kCompactionStepEntries > 0;
+
+  /**
+   * setValue() of a key in [kFirstInPlaceKey, kFirstInPlaceKey + kNumInPlaceKeys) programs the newest line of the key
+   * again, instead of appending a line, if that line is on the active page and the new value only clears bits of the
+   * stored value. Flash only turns 1 bits into 0 bits without an erase, so e.g. a thermometer-coded counter (0xFFFF,
+   * 0xFFFE, 0xFFFC, ...) or a set of flags that are cleared once only appends a line when it is reset. A power loss
+   * during such an update may leave some of the bits cleared. The flash backend must allow programming a line again,
+   * as most NOR flash does; STM32F1 only accepts programming a programmed half-word to 0.
+   */
+  constexpr static const std::size_t kFirstInPlaceKey = TraitsT::kFirstInPlaceKey;
+  constexpr static const std::size_t kNumInPlaceKeys = TraitsT::kNumInPlaceKeys;
+  static_assert(kFirstInPlaceKey + kNumInPlaceKeys <= kNumKeys || kNumInPlaceKeys == 0, "In-place keys out of range");
 
+  /**
+   * The pages form a ring. Values are appended to the active page (the head of the ring). When it is full, writing
+   * continues on the next page, which is always kept erased. Once the ring runs out of erased pages, the live entries
+   * of the oldest page (the tail of the ring) are copied to the active page and the oldest page is erased.
+   *
+   * Each page starts with kPageHeaderLines header lines, each written once:
+   *  - begin: generation of the page, one more than that of the previous page. Written when the page becomes the
+   *    head, so a page without it is erased. initialize() orders the pages by generation.
+   *  - active: written once all live entries of the tail were copied to the page, or right away if there was nothing
+   *    to copy. A page that holds data but is not active is receiving, i.e., its page switch was interrupted.
+   *  - closed: number of data lines, written when writing continues on the next page. The tail of a ring without
+   *    erased pages whose head is active is obsolete and only waits to be erased.
+   */
   struct Config_t {
-    PagePtr_t pages[2];
-    constexpr static const size_t pageSize = 1024;
+    PagePtr_t pages[kNumPages];
+    constexpr static const size_t pageSize = TraitsT::kPageSize;
   };
+  static_assert(Config_t::pageSize % sizeof(FlashLine_t) == 0, "Page size must be a multiple of the line size");
+
+  using KeyIndex_t = typename TraitsT::template KeyIndex<key_type, value_type, kNumKeys, kNumPages,
+                                                         Config_t::pageSize / sizeof(FlashLine_t)>;
+
+  /// Keys seen by a newest-first scan. A scan sees at most one key per data line of the ring.
+  using KeySet_t = typename TraitsT::template KeySet<
+      key_type, kNumKeys, kNumPages * (Config_t::pageSize / sizeof(FlashLine_t) - kPageHeaderLines)>;
+
+  using FlashHal_t = typename TraitsT::FlashHal;
+  using Statistics_t = typename TraitsT::template Statistics<kNumPages>;
+  using Trace_t = typename TraitsT::Trace;
+  using ReadSync_t = typename TraitsT::ReadSync;
+  using GcPolicy_t = typename TraitsT::GcPolicy;
+
+  /**
+   * With concurrent reads, getValue(), findValue(), readValueIfAvailable(), getRecord(), loadValues(), countLiveKeys()
+   * and numEntriesLeftOnActivePage() may run in other threads, RTOS tasks or ISRs while a write, compaction step or
+   * page switch is in progress. They never block: they scan the ring as of the end of the last completed write, and a
+   * page is only erased once the new active page holding its live entries was published. A read that overlapped with
+   * the start of an erase is repeated. Writes, poll(), formatFlash() and the other members must still be serialized,
+   * i.e., called from a single writer at a time, and initialize() must complete before the first concurrent read.
+   * In-place keys may read a partially updated value.
+   */
+  constexpr static const bool kConcurrentReads = ReadSync_t::kEnabled;
+  static_assert(!kConcurrentReads || (!KeyIndex_t::kEnabled && !Statistics_t::kEnabled),
+                "Concurrent reads need NoIndex and NoStatistics");
+  static_assert(!kConcurrentReads || (kNumPages <= 256 && Config_t::pageSize / sizeof(FlashLine_t) < 65536),
+                "The published view holds 8 bit page indices and 16 bit line offsets");
+
+  /// Number of lines that are programmed with a single bulk operation, 0 if the flash backend has none.
+  constexpr static const std::size_t kBulkProgramLines = BulkProgramLines<FlashHal_t>::value;
 
   class FlashUnlock {
    public:
-    FlashUnlock() { flash_unlock(); }
-    ~FlashUnlock() { flash_lock(); }
+    FlashUnlock() { FlashHal_t::unlock(); }
+    ~FlashUnlock() { FlashHal_t::lock(); }
   };
 
   class SingleElementVisitor {
@@ -59,16 +323,107 @@ class FlashFairyPP {
     const value_type second;
   };
 
+  /**
+   * \brief A set of key/value pairs that is committed to flash as a whole by setValues().
+   *
+   * Setting a key that is already part of the batch replaces its value.
+   */
+  template <std::size_t Capacity>
+  class WriteBatch {
+    static_assert(Capacity <= kValueMask, "Batch size must fit into a value");
+
+   public:
+    struct Entry {
+      key_type first;
+      value_type second;
+    };
+
+    /**
+     * \brief Add a key to the batch or replace its value.
+     *
+     * \return false if the key is out of range or the batch is full.
+     */
+    bool setValue(const key_type key, const value_type value) {
+      if (key >= kNumKeys) {
+        return false;
+      }
+      for (std::size_t i = 0; i < size_; ++i) {
+        if (entries_[i].first == key) {
+          entries_[i].second = value;
+          return true;
+        }
+      }
+      if (size_ == Capacity) {
+        return false;
+      }
+      entries_[size_] = Entry{key, value};
+      ++size_;
+      return true;
+    }
+
+    bool contains(const key_type key) const {
+      for (const Entry& entry : *this) {
+        if (entry.first == key) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    const Entry* begin() const { return entries_; }
+
+    const Entry* end() const { return entries_ + size_; }
+
+    std::size_t size() const { return size_; }
+
+    bool empty() const { return size_ == 0; }
+
+    void clear() { size_ = 0; }
+
+    /**
+     * \brief Remove every entry whose position is flagged in positions. Keeps the order of the remaining entries.
+     */
+    void removePositions(const BitArray<uint32_t, Capacity>& positions) {
+      std::size_t kept = 0;
+      for (std::size_t i = 0; i < size_; ++i) {
+        if (!positions.isSet(i)) {
+          entries_[kept] = entries_[i];
+          ++kept;
+        }
+      }
+      size_ = kept;
+    }
+
+   private:
+    Entry entries_[Capacity];
+    std::size_t size_ = 0;
+  };
+
   /**
    * \brief Initialize the FlashFairy for the given memory area.
+   *
+   * \return False if flash holds values of the format before page headers that cannot be migrated, see
+   * migrateLegacyPage(). Flash is left untouched, the store reads as empty and rejects writes until formatFlash().
    */
   bool initialize(const Config_t& configuration);
 
   /**
    * \brief Read a value from flash storage.
+   *
+   * \return The stored value or npos, if the key was never written.
    */
   value_type getValue(const key_type key) const;
 
+  /**
+   * \brief Read a value from flash storage.
+   *
+   * Without a key index, the active page is scanned newest-first starting at the write cursor and the scan ends at the
+   * first entry for key. Recently written keys resolve in a few reads, a key that was never written costs one pass.
+   *
+   * \return Whether a value for key was found. value is only modified if it was.
+   */
+  bool findValue(const key_type key, value_type& value) const;
+
   /**
    * \brief Commit a new value to flash storage.
    *
@@ -86,8 +441,8 @@ class FlashFairyPP {
    */
   template <typename V>
   bool readValueIfAvailable(const key_type key, V& value) const {
-    const value_type tmpValue = getValue(key);
-    bool valueAvailable = (tmpValue != npos);
+    value_type tmpValue;
+    const bool valueAvailable = findValue(key, tmpValue);
     if (valueAvailable) {
       value = static_cast<V>(tmpValue);
     }
@@ -95,21 +450,226 @@ class FlashFairyPP {
   }
 
   /**
-   * \brief Reader function that scans through the entire active flash page and calls Visitor for every value that was
-   * encountered.
+   * \brief Commit a record of up to kMaxRecordSize bytes to flash storage.
+   *
+   * Records and values share the key space, the newest write to a key determines whether it holds a value or a record.
+   * If the new record is identical to the stored record, do nothing.
+   *
+   * \return If the record was stored or the record equals the stored record.
+   */
+  bool setRecord(const key_type key, const void* data, const std::size_t size);
+
+  /**
+   * \brief Read a record from flash storage.
+   *
+   * Copies at most bufferSize bytes to buffer. If recordSize is given, it receives the size of the stored record.
+   *
+   * \return Whether a record was found for key.
+   */
+  bool getRecord(const key_type key, void* buffer, const std::size_t bufferSize,
+                 std::size_t* recordSize = nullptr) const;
+
+  /// One bit per key, as filled by loadValues().
+  using KeyBitmap_t = BitArray<uint32_t, kNumKeys>;
+
+  /**
+   * \brief Read the latest value of every key in a single newest-first pass over the ring, e.g., to restore all
+   * settings at boot.
+   *
+   * values must hold kNumKeys elements. For every key that holds a value, values[key] receives the value and the bit
+   * of key is set in present. Other elements of values are left untouched; keys that hold a record are not loaded.
+   * For large key spaces, liveEntries() yields the same values without a buffer of kNumKeys values.
+   *
+   * \return Number of loaded values.
+   */
+  std::size_t loadValues(value_type* values, KeyBitmap_t& present) const;
+
+  template <std::size_t N>
+  std::size_t loadValues(value_type (&values)[N], KeyBitmap_t& present) const {
+    static_assert(N >= kNumKeys, "values must hold kNumKeys elements");
+    return loadValues(&values[0], present);
+  }
+
+  template <typename T>
+  bool setRecord(const key_type key, const T& value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Records must be trivially copyable");
+    return setRecord(key, &value, sizeof(T));
+  }
+
+  /**
+   * \brief Read a record into value. Fails without modifying value if the stored record has a different size.
+   */
+  template <typename T>
+  bool getRecord(const key_type key, T& value) const {
+    static_assert(std::is_trivially_copyable<T>::value, "Records must be trivially copyable");
+    T tmpValue;
+    std::size_t recordSize = 0;
+    if (getRecord(key, &tmpValue, sizeof(T), &recordSize) && recordSize == sizeof(T)) {
+      value = tmpValue;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * \brief Reader function that scans through all pages of the ring, oldest first, and calls Visitor for every value
+   * that was encountered. Records are not reported.
    *
-   * Note that Visitor may be called multiple times for a single key - the last call contains the valid value.
+   * Note that Visitor may be called multiple times for a single key - the last call contains the valid value. Use
+   * liveEntries() to get every key once.
    */
   template <class Visitor>
   void visitEntries(Visitor& visitor) const {
-    const LinePtr_t pageEnd = activePage_ + linesPerPage();
-    for (LinePtr_t linePtr = activePage_; linePtr < pageEnd; linePtr += kPtrLineIncrement) {
-      if (!isEmptyLine(*linePtr)) {
+    visitLinesOldestFirst([&visitor](const LinePtr_t linePtr, std::size_t) {
+      if (isDataLine(*linePtr)) {
         const key_type key = GetKey(*linePtr);
         const value_type value = GetValue(*linePtr);
         visitor(key, value);
       }
+    });
+  }
+
+ private:
+  /**
+   * \brief Part of the ring that a scan covers: the pages from the tail to the head, up to the write cursor.
+   */
+  struct View {
+    std::size_t activePageIndex;
+    std::size_t tailPageIndex;
+    LinePtr_t freeLine;
+  };
+
+ public:
+  /// Key and current value, as yielded by liveEntries().
+  using Entry_t = std::pair<key_type, value_type>;
+
+  /**
+   * \brief Forward iterator over the live values of a store, newest first. See liveEntries().
+   */
+  class LiveEntryIterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Entry_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Entry_t*;
+    using reference = const Entry_t&;
+
+    /// End iterator.
+    LiveEntryIterator() = default;
+
+    LiveEntryIterator(const BasicFlashFairyPP& flashFairy, const View& view)
+        : flashFairy_(&flashFairy), view_(view), pageIndex_(view.activePageIndex), linePtr_(view.freeLine) {
+      ++*this;
+    }
+
+    reference operator*() const { return entry_; }
+    pointer operator->() const { return &entry_; }
+
+    LiveEntryIterator& operator++() {
+      while (seen_.size() < kNumKeys && flashFairy_->findPreviousEntryLine(view_, pageIndex_, linePtr_)) {
+        // A concurrent read may see the line change if its page is erased, so the line is read once.
+        const FlashLine_t line = *linePtr_;
+        // A record hides older values of its key.
+        if (isEntryLine(line) && seen_.insert(getEntryKey(line)) && isDataLine(line)) {
+          entry_ = Entry_t(GetKey(line), GetValue(line));
+          return *this;
+        }
+      }
+      flashFairy_ = nullptr;
+      return *this;
+    }
+
+    LiveEntryIterator operator++(int) {
+      LiveEntryIterator previous = *this;
+      ++*this;
+      return previous;
+    }
+
+    bool operator==(const LiveEntryIterator& other) const {
+      return flashFairy_ == other.flashFairy_ && (flashFairy_ == nullptr || linePtr_ == other.linePtr_);
+    }
+    bool operator!=(const LiveEntryIterator& other) const { return !(*this == other); }
+
+   private:
+    /// nullptr once the iterator reached the end.
+    const BasicFlashFairyPP* flashFairy_ = nullptr;
+    View view_ = View();
+    std::size_t pageIndex_ = 0;
+    LinePtr_t linePtr_ = nullptr;
+    KeySet_t seen_;
+    Entry_t entry_;
+  };
+
+  /**
+   * \brief Range over the live values of a store, see liveEntries().
+   */
+  class LiveEntryRange {
+   public:
+    explicit LiveEntryRange(const BasicFlashFairyPP& flashFairy) : flashFairy_(flashFairy) {}
+
+    LiveEntryIterator begin() const { return LiveEntryIterator(flashFairy_, flashFairy_.writerView()); }
+    LiveEntryIterator end() const { return LiveEntryIterator(); }
+
+   private:
+    const BasicFlashFairyPP& flashFairy_;
+  };
+
+  /**
+   * \brief Every key that holds a value exactly once with its current value, e.g.,
+   * `for (const auto& entry : flashFairy.liveEntries())`.
+   *
+   * Keys are yielded newest first, driven by a single newest-first pass over the ring that stops once every key was
+   * seen. Keys that hold a record are skipped. Writing to the store invalidates all iterators. Iterate from the writer
+   * only, concurrent readers use loadValues().
+   */
+  LiveEntryRange liveEntries() const { return LiveEntryRange(*this); }
+
+  /**
+   * \brief Commit all values of a batch to flash storage at once.
+   *
+   * Entries whose value is already stored are removed from the batch. The remaining entries are written between a
+   * begin and a commit marker under a single flash unlock, switching pages at most once beforehand. If power is lost
+   * before the commit marker is written, initialize() discards the whole batch.
+   *
+   * \return If the batch was stored. On failure, flash is left untouched.
+   */
+  template <std::size_t Capacity>
+  bool setValues(WriteBatch<Capacity>& batch) {
+    if (migrationRefused_) {
+      return false;
+    }
+    const std::size_t replacedLines = dropUnchangedEntries(batch);
+    if (batch.empty()) {
+      statistics_.countSkippedWrite();
+      return true;
+    }
+
+    if (!reserveLines(batch.size() + 2, batch)) {
+      return false;
+    }
+
+    const std::size_t firstLineIndex = getLineIndex(activePageIndex_, freeLine_) + 1;
+    {
+      FlashUnlock unlock;
+      LineWriter writer(*this);
+      writer.append(SetLine(kBatchBeginKey, static_cast<value_type>(batch.size())));
+      for (const auto& entry : batch) {
+        writer.append(SetLine(entry.first, entry.second));
+      }
+      writer.append(SetLine(kBatchCommitKey, static_cast<value_type>(batch.size())));
+    }
+
+    // The batch only becomes visible once it is committed.
+    std::size_t lineIndex = firstLineIndex;
+    for (const auto& entry : batch) {
+      index_.update(entry.first, entry.second, lineIndex);
+      markWrittenDuringCompaction(entry.first);
+      ++lineIndex;
     }
+    statistics_.countWrite(batch.size());
+    numLiveLines_ = numLiveLines_ + batch.size() - replacedLines;
+    compactAfterWrite();
+    return true;
   }
 
   template <class Visitor>
@@ -117,117 +677,1469 @@ class FlashFairyPP {
     bool pageFull = !copyFromVisitorToActivePage(visitor);
     if (pageFull) {
       switchPages(visitor);
-      return copyFromVisitorToActivePage(visitor);
+      pageFull = !copyFromVisitorToActivePage(visitor);
     }
-    return true;
+    if (!pageFull) {
+      statistics_.countWrite(1);
+    }
+    compactAfterWrite();
+    return !pageFull;
+  }
+
+  /**
+   * \brief Advance a pending incremental compaction by one step, to be called when idle.
+   *
+   * A step either copies up to kCompactionStepEntries live entries or erases the compacted page. Without a pending
+   * compaction, runs compactNow() if the GcPolicy asks for it.
+   *
+   * \return Whether a compaction is still pending.
+   */
+  bool poll() {
+    if (migrationRefused_) {
+      return false;
+    }
+    if (!isCompactionPending() && GcPolicy_t::shouldCompact(getLineCounts())) {
+      compactNow();
+    }
+    const bool pending = stepCompaction(kCompactionStepEntries, true);
+    publishView();
+    return pending;
+  }
+
+  bool isCompactionPending() const { return compactionState_ != CompactionState::kIdle; }
+
+  /**
+   * \brief Reclaim the stale lines of the oldest page now, e.g., when idle or before a burst of writes.
+   *
+   * The live entries of the oldest page are copied to the active page, or to the next page if they do not fit, and the
+   * oldest page is erased. Unlike a write that finds the active page full, this neither has to fit a new entry nor
+   * runs inside a write. A pending incremental compaction is finished first. With two pages, the whole ring is
+   * compacted.
+   *
+   * \return Whether a page was compacted, false if there were no stale lines.
+   */
+  bool compactNow();
+
+  /**
+   * \brief Number of data lines that compaction can reclaim: superseded entries, aborted batches and batch markers.
+   *
+   * Tracked incrementally since initialize(), which counts them in a newest-first pass over the ring.
+   */
+  std::size_t reclaimableLines() const { return (numUsedLines_ > numLiveLines_) ? numUsedLines_ - numLiveLines_ : 0; }
+
+  /// Number of lines that hold the newest entry of a key.
+  std::size_t numLiveLines() const { return numLiveLines_; }
+
+  /**
+   * \brief Live, stale and free lines of the ring, as passed to the GcPolicy.
+   */
+  LineCounts getLineCounts() const {
+    return LineCounts{numLiveLines_, reclaimableLines(), numEntriesLeft(writerView()), kNumPages * dataLinesPerPage()};
   }
 
   /**
-   * \brief Forcefully clear both flash pages.
+   * \brief Forcefully clear all flash pages.
    */
   bool formatFlash();
   std::size_t numEntriesLeftOnActivePage() const;
 
+  /**
+   * \brief Operation counters since initialize(), see Statistics.h. Counts nothing unless the traits select
+   * Statistics.
+   */
+  const Statistics_t& getStatistics() const { return statistics_; }
+
+  /**
+   * \brief Number of keys that hold a value or a record. Takes a newest-first pass over the ring.
+   */
+  std::size_t countLiveKeys() const;
+
  private:
-  PagePtr_t activePage_;
   Config_t configuration_;
+  /// Page that is currently written to, i.e., the head of the ring.
+  std::size_t activePageIndex_;
+  /// Oldest page that holds data, i.e., the tail of the ring.
+  std::size_t tailPageIndex_;
+  /// Next line to be written on the active page. Equals the page end if the active page is full.
+  LinePtr_t freeLine_;
+  KeyIndex_t index_;
+  Statistics_t statistics_;
+  /// View of the ring that concurrent readers scan, published whenever the writer completed a change.
+  ReadSync_t readSync_;
+  /// Data lines of the ring that are programmed, and those among them that hold the newest entry of a key.
+  std::size_t numUsedLines_ = 0;
+  std::size_t numLiveLines_ = 0;
+
+  enum class CompactionState : uint8_t { kIdle, kCopying, kErasing };
+  CompactionState compactionState_ = CompactionState::kIdle;
+  /// initialize() refused to migrate the values of the format before page headers. Writes would erase them.
+  bool migrationRefused_ = false;
+  /// Next line of the tail page to be examined by incremental compaction.
+  LinePtr_t compactionLine_ = nullptr;
+  /// Upper bound of the lines that incremental compaction still copies. They are kept free on the active page.
+  std::size_t compactionLinesLeft_ = 0;
+  /// Lines of the tail page that held the newest entry of their key when incremental compaction began.
+  using CompactionLines_t =
+      BitArray<uint32_t, kIncrementalCompaction ? static_cast<uint32_t>(Config_t::pageSize / sizeof(FlashLine_t)) : 1>;
+  CompactionLines_t compactionLiveLines_;
+  /// Keys written since incremental compaction began. Their entries on the tail page are stale and not copied.
+  using WrittenKeys_t = BitArray<uint32_t, kIncrementalCompaction ? static_cast<uint32_t>(kNumKeys) : 1>;
+  WrittenKeys_t compactionWrittenKeys_;
+
+  class LineWriter;
+
+  /// Visitor that contains no keys.
+  struct NoKeys {
+    constexpr bool contains(const key_type) const { return false; }
+  };
 
-  static key_type GetKey(const FlashLine_t line) { return static_cast<key_type>(line >> (sizeof(value_type) * 8)); }
-  static value_type GetValue(const FlashLine_t line) { return static_cast<value_type>(line); }
+  constexpr static key_type GetKey(const FlashLine_t line) {
+    return static_cast<key_type>((line >> kValueBits) & kKeyMask);
+  }
+  constexpr static value_type GetValue(const FlashLine_t line) { return static_cast<value_type>(line & kValueMask); }
 
-  static FlashLine_t SetLine(key_type key, value_type value) {
-    return (static_cast<FlashLine_t>(key) << (sizeof(value) * 8)) | value;
+  constexpr static FlashLine_t SetLine(key_type key, value_type value) {
+    return (static_cast<FlashLine_t>(key & kKeyMask) << kValueBits) | (value & kValueMask);
   }
 
   template <class Visitor>
   bool copyFromVisitorToActivePage(const Visitor& visitor) {
-    LinePtr_t freeLineInFlash = findFreeLine(activePage_);
-    const LinePtr_t activePageEnd = getPageEnd(activePage_);
+    const LinePtr_t activePageEnd = getPageEnd(activePage());
 
     FlashUnlock unlock;
     for (const auto visitorEntry : visitor) {
-      if (freeLineInFlash == nullptr || freeLineInFlash > activePageEnd) {
+      if (freeLine_ + compactionLinesLeft_ * kPtrLineIncrement >= activePageEnd) {
         return false;
       } else {
-        FlashLine_t line = SetLine(visitorEntry.first, visitorEntry.second);
-        FlashFairy_Write_Word(freeLineInFlash, line);
-        ++freeLineInFlash;
+        index_.update(visitorEntry.first, visitorEntry.second, getLineIndex(activePageIndex_, freeLine_));
+        appendLine(SetLine(visitorEntry.first, visitorEntry.second));
+        markWrittenDuringCompaction(visitorEntry.first);
       }
     }
     return true;
   }
 
   /**
-   * Compacts contents of active page to inactive page.
-   * Swaps the active/inactive pointers.
-   *
-   * Does not copy any line that the Visitor claims to contain.
+   * \brief Make sure that the active page has requiredLines free lines, switching pages at most once.
    *
-   * Formats the now inactive page.
+   * Keys contained in visitor are not copied when switching pages.
    *
-   * \return the Address of the first free line in the new page or nullptr, if
-   *         the new page is full.
+   * \return false without modifying flash if the lines do not fit.
    */
   template <class Visitor>
-  LinePtr_t switchPages(const Visitor& visitor) {
-    const PagePtr_t inactivePage = getInactivePage();
-
-    LinePtr_t freeLine = inactivePage;
-
-    {
-      BitArray<uint32_t, kNumKeys> bitArray;
-      const LinePtr_t inactivePageEnd = getPageEnd(inactivePage);
-      const LinePtr_t activePageEnd = getPageEnd(activePage_);
-
-      FlashUnlock unlock;
-
-      if (!isEmptyPage(inactivePage)) {
-        FlashFairy_Erase_Page(inactivePage);
-      }
-
-      for (LinePtr_t linePtr = activePageEnd - 1; linePtr >= activePage_ && freeLine < inactivePageEnd; --linePtr) {
-        if (!isEmptyLine(*linePtr)) {
-          auto lineKey = GetKey(*linePtr);
-          if (!bitArray.isSet(lineKey) && !visitor.contains(lineKey)) {
-            FlashFairy_Write_Word(freeLine, *linePtr);
-            ++freeLine;
-          }
-          bitArray.setBit(lineKey);
-        }
+  bool reserveLines(const std::size_t requiredLines, const Visitor& visitor) {
+    if (numEntriesLeft(writerView()) < requiredLines + compactionLinesLeft_) {
+      if (countReclaimedLines(visitor) + requiredLines > dataLinesPerPage()) {
+        return false;
       }
-
-      // Format the active page
-      FlashFairy_Erase_Page(activePage_);
+      switchPages(visitor);
     }
-
-    // swap the pointers.
-    activePage_ = inactivePage;
-
-    return freeLine;
+    return true;
   }
 
-  static LinePtr_t findFreeLine(PagePtr_t page);
-
-  constexpr static bool isEmptyLine(const FlashLine_t line) { return line == kFreePattern; }
+  /**
+   * \brief Copy a value line or a whole record to the active page. Flash must be unlocked.
+   */
+  void copyEntryToActivePage(const LinePtr_t linePtr, LineWriter& writer) {
+    const std::size_t entryLines = getEntryLines(*linePtr);
+    if (isDataLine(*linePtr)) {
+      index_.update(GetKey(*linePtr), GetValue(*linePtr), getLineIndex(activePageIndex_, freeLine_));
+    }
+    // Records are copied including their payload lines.
+    for (LinePtr_t copiedLine = linePtr - (entryLines - 1) * kPtrLineIncrement; copiedLine <= linePtr;
+         copiedLine += kPtrLineIncrement) {
+      writer.append(*copiedLine);
+    }
+    statistics_.countCopied(entryLines);
+    compactionLinesLeft_ = (compactionLinesLeft_ > entryLines) ? compactionLinesLeft_ - entryLines : 0;
+  }
 
-  static bool isEmptyPage(const PagePtr_t page) {
-    // A page is empty if its first line is the free patern.
-    return isEmptyLine(*page);
+  constexpr static bool isInPlaceKey(const key_type key) {
+    return key >= kFirstInPlaceKey && key - kFirstInPlaceKey < kNumInPlaceKeys;
   }
 
-  constexpr static std::size_t linesPerPage() { return Config_t::pageSize / sizeof(FlashLine_t); }
+  /**
+   * \brief Update the value line of key in place if it is on the active page and value only clears bits.
+   *
+   * \return Whether the update is done, i.e., value was stored or equals the stored value.
+   */
+  bool setValueInPlace(const key_type key, const value_type value) {
+    LinePtr_t entryLine = nullptr;
+    std::size_t entryPageIndex = 0;
+    visitLinesNewestFirst([key, &entryLine, &entryPageIndex](const LinePtr_t linePtr, const std::size_t pageIndex) {
+      if (getEntryKey(*linePtr) != key) {
+        return true;
+      }
+      entryLine = linePtr;
+      entryPageIndex = pageIndex;
+      return false;
+    });
+    if (entryLine == nullptr || !isDataLine(*entryLine)) {
+      return false;
+    }
+    const value_type storedValue = GetValue(*entryLine);
+    if (value == storedValue) {
+      statistics_.countSkippedWrite();
+      return true;
+    } else if (entryPageIndex != activePageIndex_ || (value & ~storedValue & kValueMask) != 0) {
+      return false;
+    }
+    {
+      FlashUnlock unlock;
+      programLine(entryLine, SetLine(key, value));
+    }
+    index_.update(key, value, getLineIndex(entryPageIndex, entryLine));
+    statistics_.countWrite(1);
+    return true;
+  }
 
-  constexpr static LinePtr_t getPageEnd(PagePtr_t page) { return page + linesPerPage(); }
+  /**
+   * \brief Whether linePtr holds the newest entry of its key.
+   */
+  bool isNewestEntry(const LinePtr_t linePtr) const {
+    const key_type key = getEntryKey(*linePtr);
+    bool newest = false;
+    visitLinesNewestFirst([key, linePtr, &newest](const LinePtr_t newerLinePtr, std::size_t) {
+      if (getEntryKey(*newerLinePtr) != key) {
+        return true;
+      }
+      newest = newerLinePtr == linePtr;
+      return false;
+    });
+    return newest;
+  }
+
+  /**
+   * \brief Whether the pending compaction copies the entry at linePtr on the tail page.
+   */
+  bool isCopiedByCompaction(const LinePtr_t linePtr) const {
+    if (!kIncrementalCompaction) {
+      // Only initialize() resumes a synchronous compaction and finishes it right away, so a scan per entry will do.
+      // Lines of aborted batches and superseded entries are never the newest.
+      return isEntryLine(*linePtr) && isNewestEntry(linePtr);
+    }
+    // Skipping a line that is not marked live reads no flash.
+    return compactionLiveLines_.isSet(getCompactionLineIndex(linePtr)) &&
+           !compactionWrittenKeys_.isSet(getEntryKey(*linePtr));
+  }
+
+  uint32_t getCompactionLineIndex(const LinePtr_t linePtr) const {
+    return static_cast<uint32_t>((linePtr - configuration_.pages[tailPageIndex_]) / kPtrLineIncrement);
+  }
+
+  /**
+   * \brief Keep a pending incremental compaction from copying the tail entry of key over the entry just written.
+   */
+  void markWrittenDuringCompaction(const key_type key) {
+    if (kIncrementalCompaction && compactionState_ == CompactionState::kCopying) {
+      compactionWrittenKeys_.setBit(key);
+    }
+  }
+
+  /**
+   * \brief Start to compact the tail page incrementally. Its live entries except those in visitor are copied later.
+   *
+   * Finds the live entries in a single newest-first scan, so that the following steps need not scan the ring.
+   */
+  template <class Visitor>
+  void beginCompaction(const Visitor& visitor) {
+    Trace_t::onCompactionBegin(configuration_.pages[tailPageIndex_]);
+    statistics_.countCompaction();
+    compactionState_ = CompactionState::kCopying;
+    compactionLine_ = getDataStart(configuration_.pages[tailPageIndex_]);
+    compactionLinesLeft_ = 0;
+    compactionLiveLines_ = CompactionLines_t();
+    compactionWrittenKeys_ = WrittenKeys_t();
+    visitReclaimedLines(tailPageIndex_, visitor, [this](const LinePtr_t linePtr) {
+      compactionLinesLeft_ += getEntryLines(*linePtr);
+      if (kIncrementalCompaction) {
+        compactionLiveLines_.setBit(getCompactionLineIndex(linePtr));
+      }
+    });
+  }
+
+  /**
+   * \brief Copy up to maxEntries live entries of the tail page or, if allowed and all are copied, erase it.
+   *
+   * \return Whether the compaction is still pending.
+   */
+  bool stepCompaction(const std::size_t maxEntries, const bool allowErase) {
+    if (compactionState_ == CompactionState::kCopying) {
+      const LinePtr_t tailDataEnd = getDataEnd(tailPageIndex_);
+      std::size_t numCopied = 0;
+      FlashUnlock unlock;
+      LineWriter writer(*this);
+      for (; compactionLine_ < tailDataEnd && numCopied < maxEntries; compactionLine_ += kPtrLineIncrement) {
+        if (isCopiedByCompaction(compactionLine_)) {
+          copyEntryToActivePage(compactionLine_, writer);
+          ++numCopied;
+        }
+      }
+      writer.flush();
+      if (compactionLine_ >= tailDataEnd) {
+        // The tail is obsolete from now on.
+        Trace_t::onCompactionEnd(configuration_.pages[tailPageIndex_]);
+        writeHeaderLine(activePage(), kActiveLine, kPageActiveKey, getPageGeneration(activePage()));
+        compactionState_ = CompactionState::kErasing;
+        compactionLinesLeft_ = 0;
+      }
+    } else if (compactionState_ == CompactionState::kErasing && allowErase) {
+      // Concurrent readers leave the tail before it is erased. The active page holds its live entries by now.
+      const std::size_t erasedPageIndex = tailPageIndex_;
+      tailPageIndex_ = getNextPageIndex(tailPageIndex_);
+      compactionState_ = CompactionState::kIdle;
+      releaseLines(erasedPageIndex);
+      publishView();
+      FlashUnlock unlock;
+      erasePage(erasedPageIndex);
+    }
+    return isCompactionPending();
+  }
+
+  /**
+   * \brief Run a pending compaction to its end.
+   */
+  void finishCompaction() {
+    while (stepCompaction(static_cast<std::size_t>(-1), true)) {
+    }
+  }
+
+  /**
+   * \brief Advance compaction once a write is complete. Completes the page switch of a synchronous compaction and
+   * publishes the write to concurrent readers.
+   */
+  void compactAfterWrite() {
+    if (kIncrementalCompaction) {
+      stepCompaction(kCompactionStepEntries, false);
+    } else {
+      finishCompaction();
+    }
+    publishView();
+  }
+
+  /// Positions of the header lines within a page.
+  constexpr static const std::size_t kBeginLine = 0;
+  constexpr static const std::size_t kActiveLine = 1;
+  constexpr static const std::size_t kClosedLine = 2;
+
+  static bool hasPageHeader(const PagePtr_t page) { return GetKey(page[kBeginLine]) == kPageBeginKey; }
+  static value_type getPageGeneration(const PagePtr_t page) { return GetValue(page[kBeginLine]); }
+  static bool isPageActive(const PagePtr_t page) { return GetKey(page[kActiveLine]) == kPageActiveKey; }
+  static bool isPageClosed(const PagePtr_t page) { return GetKey(page[kClosedLine]) == kPageClosedKey; }
+
+  /**
+   * \brief Write a header line of page. Flash must be unlocked.
+   */
+  void writeHeaderLine(const PagePtr_t page, const std::size_t position, const key_type key, const value_type value) {
+    programLine(page + position * kPtrLineIncrement, SetLine(key, value));
+  }
+
+  /**
+   * \brief Program a single line. Flash must be unlocked.
+   */
+  void programLine(const LinePtr_t linePtr, const FlashLine_t line) {
+    Trace_t::onProgram(linePtr, 1);
+    statistics_.countProgrammed(1);
+    FlashHal_t::programLine(linePtr, line);
+  }
+
+  /**
+   * \brief Number of programmed data lines of a page.
+   */
+  std::size_t countDataLines(const std::size_t pageIndex) const {
+    const PagePtr_t page = configuration_.pages[pageIndex];
+    const LinePtr_t dataEnd = (pageIndex == activePageIndex_) ? freeLine_ : findFreeLine(page);
+    return static_cast<std::size_t>(dataEnd - getDataStart(page)) / kPtrLineIncrement;
+  }
+
+  /**
+   * \brief Account for the lines of a page that leaves the ring before it is erased.
+   */
+  void releaseLines(const std::size_t pageIndex) {
+    const std::size_t releasedLines = countDataLines(pageIndex);
+    numUsedLines_ = (numUsedLines_ > releasedLines) ? numUsedLines_ - releasedLines : 0;
+  }
+
+  /**
+   * \brief Count the used and live lines of the ring from scratch. Takes a newest-first pass over the ring.
+   */
+  void countLines() {
+    numUsedLines_ = countDataLines(activePageIndex_);
+    for (std::size_t pageIndex = tailPageIndex_; pageIndex != activePageIndex_;
+         pageIndex = getNextPageIndex(pageIndex)) {
+      numUsedLines_ += countDataLines(pageIndex);
+    }
+
+    numLiveLines_ = 0;
+    KeySet_t seen;
+    visitLinesNewestFirst([this, &seen](const LinePtr_t linePtr, std::size_t) {
+      if (seen.insert(getEntryKey(*linePtr))) {
+        numLiveLines_ += getEntryLines(*linePtr);
+      }
+      return true;
+    });
+  }
+
+  /**
+   * \brief Erase a page of the ring. Flash must be unlocked and the page must not be part of the published view.
+   */
+  void erasePage(const std::size_t pageIndex) {
+    readSync_.beginErase();
+    Trace_t::onErase(configuration_.pages[pageIndex]);
+    statistics_.countErase(pageIndex);
+    FlashHal_t::erasePage(configuration_.pages[pageIndex]);
+  }
+
+  /**
+   * \brief Record the number of data lines of the active page before writing continues on the next page.
+   *
+   * The page may already be closed if the previous page switch was interrupted by a power loss.
+   */
+  void closeActivePage() {
+    if (hasPageHeader(activePage()) && activePage()[kClosedLine] == kFreePattern && dataLinesPerPage() <= kValueMask) {
+      const std::size_t dataLines =
+          static_cast<std::size_t>(freeLine_ - getDataStart(activePage())) / kPtrLineIncrement;
+      writeHeaderLine(activePage(), kClosedLine, kPageClosedKey, static_cast<value_type>(dataLines));
+    }
+  }
+
+  /**
+   * \brief End of the data lines of a page. Falls back to the page end for pages that were not closed.
+   */
+  LinePtr_t getDataEnd(const std::size_t pageIndex) const { return getDataEnd(writerView(), pageIndex); }
+
+  LinePtr_t getDataEnd(const View& view, const std::size_t pageIndex) const {
+    const PagePtr_t page = configuration_.pages[pageIndex];
+    if (pageIndex == view.activePageIndex) {
+      return view.freeLine;
+    } else if (isPageClosed(page) && GetValue(page[kClosedLine]) <= dataLinesPerPage()) {
+      return getDataStart(page) + GetValue(page[kClosedLine]) * kPtrLineIncrement;
+    } else {
+      return getPageEnd(page);
+    }
+  }
+
+  /**
+   * \brief Write line at the write cursor and advance the cursor. Flash must be unlocked.
+   */
+  void appendLine(const FlashLine_t line) {
+    openFirstPage();
+    programLine(freeLine_, line);
+    freeLine_ += kPtrLineIncrement;
+    ++numUsedLines_;
+  }
+
+  /**
+   * \brief The first page of a formatted ring is opened on its first write. There is nothing to copy to it.
+   */
+  void openFirstPage() {
+    if (freeLine_ == getDataStart(activePage()) && !hasPageHeader(activePage())) {
+      writeHeaderLine(activePage(), kBeginLine, kPageBeginKey, 0);
+      writeHeaderLine(activePage(), kActiveLine, kPageActiveKey, 0);
+    }
+  }
+
+  /**
+   * \brief Appends lines at the write cursor, programming up to kBulkProgramLines of them at once.
+   *
+   * The write cursor advances right away, the lines are programmed once the buffer is full or on destruction. Flash
+   * must be unlocked for the lifetime of the LineWriter and lines that were not programmed yet read as free lines.
+   */
+  class LineWriter {
+   public:
+    explicit LineWriter(BasicFlashFairyPP& flashFairy) : flashFairy_(flashFairy) {}
+    LineWriter(const LineWriter&) = delete;
+    LineWriter& operator=(const LineWriter&) = delete;
+    ~LineWriter() { flush(); }
+
+    void append(const FlashLine_t line) {
+      if (kBulkProgramLines == 0) {
+        flashFairy_.appendLine(line);
+        return;
+      }
+      flashFairy_.openFirstPage();
+      buffer_[numBuffered_] = line;
+      ++numBuffered_;
+      flashFairy_.freeLine_ += kPtrLineIncrement;
+      ++flashFairy_.numUsedLines_;
+      if (numBuffered_ == kBulkProgramLines) {
+        flush();
+      }
+    }
+
+    void flush() {
+      if (numBuffered_ > 0) {
+        const LinePtr_t linePtr = flashFairy_.freeLine_ - numBuffered_ * kPtrLineIncrement;
+        Trace_t::onProgram(linePtr, numBuffered_);
+        flashFairy_.statistics_.countProgrammed(numBuffered_);
+        ProgramLines<FlashHal_t>(linePtr, buffer_, numBuffered_);
+        numBuffered_ = 0;
+      }
+    }
+
+   private:
+    BasicFlashFairyPP& flashFairy_;
+    FlashLine_t buffer_[(kBulkProgramLines > 0) ? kBulkProgramLines : 1];
+    std::size_t numBuffered_ = 0;
+  };
+
+  /**
+   * \brief Call visitor(linePtr, pageIndex) for every value line and every record trailer of the ring, newest first.
+   *
+   * Lines of aborted batches are skipped. Iteration stops early if visitor returns false.
+   */
+  template <class LineVisitor>
+  void visitLinesNewestFirst(LineVisitor visitor) const {
+    visitLinesNewestFirst(writerView(), visitor);
+  }
+
+  template <class LineVisitor>
+  void visitLinesNewestFirst(const View& view, LineVisitor visitor) const {
+    std::size_t pageIndex = view.activePageIndex;
+    LinePtr_t linePtr = view.freeLine;
+    while (findPreviousEntryLine(view, pageIndex, linePtr) && visitor(linePtr, pageIndex)) {
+    }
+  }
+
+  /**
+   * \brief Move linePtr on page pageIndex to the next older value line or record trailer of the ring.
+   *
+   * Start at the write cursor of the active page of view. Lines of aborted batches are skipped.
+   *
+   * \return Whether an entry was found. If not, the scan reached the start of the tail page.
+   */
+  bool findPreviousEntryLine(const View& view, std::size_t& pageIndex, LinePtr_t& linePtr) const {
+    while (true) {
+      const PagePtr_t page = configuration_.pages[pageIndex];
+      while (linePtr > page) {
+        linePtr -= kPtrLineIncrement;
+        const FlashLine_t line = *linePtr;
+        statistics_.countScanned(1);
+        if (isEntryLine(line)) {
+          return true;
+        } else if (GetKey(line) == kBatchAbortKey) {
+          // Skip the aborted entries and their begin marker.
+          const std::size_t skippedLines = (GetValue(line) + 1u) * kPtrLineIncrement;
+          linePtr = (skippedLines < static_cast<std::size_t>(linePtr - page)) ? linePtr - skippedLines : page;
+        }
+      }
+      if (pageIndex == view.tailPageIndex) {
+        return false;
+      }
+      pageIndex = getPreviousPageIndex(pageIndex);
+      linePtr = getDataEnd(view, pageIndex);
+    }
+  }
+
+  /**
+   * \brief Call visitor(linePtr, pageIndex) for every value line and every record trailer of the ring, oldest first.
+   *
+   * Lines of aborted batches are skipped.
+   */
+  template <class LineVisitor>
+  void visitLinesOldestFirst(LineVisitor visitor) const {
+    std::size_t pageIndex = tailPageIndex_;
+    while (true) {
+      const PagePtr_t page = configuration_.pages[pageIndex];
+      const LinePtr_t lineEnd = getDataEnd(pageIndex);
+      for (LinePtr_t linePtr = page; linePtr < lineEnd; linePtr += kPtrLineIncrement) {
+        const FlashLine_t line = *linePtr;
+        statistics_.countScanned(1);
+        if (isEntryLine(line)) {
+          visitor(linePtr, pageIndex);
+        } else if (GetKey(line) == kBatchBeginKey) {
+          // A batch is followed by its entries and either a commit or an abort marker.
+          const std::size_t batchLines = (GetValue(line) + 1u) * kPtrLineIncrement;
+          if (batchLines < static_cast<std::size_t>(lineEnd - linePtr) &&
+              GetKey(linePtr[batchLines]) == kBatchAbortKey) {
+            linePtr += batchLines;
+          }
+        }
+      }
+      if (pageIndex == activePageIndex_) {
+        return;
+      }
+      pageIndex = getNextPageIndex(pageIndex);
+    }
+  }
+
+  /**
+   * \brief Flag all batch entries whose value is already stored.
+   *
+   * Without a key index, this takes a single newest-first pass over the ring.
+   *
+   * \return Number of lines of the entries that the remaining batch entries replace.
+   */
+  template <std::size_t Capacity>
+  std::size_t dropUnchangedEntries(WriteBatch<Capacity>& batch) const {
+    BitArray<uint32_t, Capacity> resolved;
+    BitArray<uint32_t, Capacity> unchanged;
+    std::size_t replacedLines = 0;
+
+    if (KeyIndex_t::kEnabled) {
+      std::size_t position = 0;
+      for (const auto& entry : batch) {
+        std::size_t entryLines = 0;
+        if (holdsValue(entry.first, entry.second, entryLines)) {
+          unchanged.setBit(position);
+        } else {
+          replacedLines += entryLines;
+        }
+        ++position;
+      }
+    } else {
+      std::size_t numResolved = 0;
+      visitLinesNewestFirst([&](const LinePtr_t linePtr, std::size_t) {
+        const key_type lineKey = getEntryKey(*linePtr);
+        std::size_t position = 0;
+        for (const auto& entry : batch) {
+          if (entry.first == lineKey && !resolved.isSet(position)) {
+            resolved.setBit(position);
+            ++numResolved;
+            if (isDataLine(*linePtr) && entry.second == GetValue(*linePtr)) {
+              unchanged.setBit(position);
+            } else {
+              replacedLines += getEntryLines(*linePtr);
+            }
+          }
+          ++position;
+        }
+        return numResolved < batch.size();
+      });
+    }
+
+    batch.removePositions(unchanged);
+    return replacedLines;
+  }
+
+  /**
+   * \brief Look up the newest entry of key before value is written to it.
+   *
+   * \return Whether key already holds value. Otherwise, replacedLines receives the number of lines of the entry that
+   * the new value replaces, 0 if key was never written.
+   */
+  bool holdsValue(const key_type key, const value_type value, std::size_t& replacedLines) const {
+    value_type storedValue;
+    if (KeyIndex_t::kEnabled && findValue(key, storedValue)) {
+      replacedLines = 1;
+      return storedValue == value;
+    } else if (KeyIndex_t::kEnabled && !kRecordsSupported) {
+      replacedLines = 0;
+      return false;
+    }
+    // The key index only holds values, a record that the value replaces is found by a scan.
+    LinePtr_t entryLine = nullptr;
+    visitLinesNewestFirst([key, &entryLine](const LinePtr_t linePtr, std::size_t) {
+      if (getEntryKey(*linePtr) != key) {
+        return true;
+      }
+      entryLine = linePtr;
+      return false;
+    });
+    replacedLines = (entryLine != nullptr) ? getEntryLines(*entryLine) : 0;
+    return entryLine != nullptr && isDataLine(*entryLine) && GetValue(*entryLine) == value;
+  }
+
+  /**
+   * \brief Call action(linePtr) for every value line or record trailer of page reclaimedPageIndex that holds the newest
+   * entry of its key, except for keys contained in visitor.
+   */
+  template <class Visitor, class Action>
+  void visitReclaimedLines(const std::size_t reclaimedPageIndex, const Visitor& visitor, Action action) const {
+    KeySet_t seen;
+    visitLinesNewestFirst([&](const LinePtr_t linePtr, const std::size_t pageIndex) {
+      const key_type lineKey = getEntryKey(*linePtr);
+      if (seen.insert(lineKey) && pageIndex == reclaimedPageIndex && !visitor.contains(lineKey)) {
+        action(linePtr);
+      }
+      return true;
+    });
+  }
+
+  /**
+   * \brief Index of the page that the next switchPages() reclaims or kNumPages if it does not reclaim a page.
+   */
+  std::size_t getReclaimedPageIndex() const {
+    const std::size_t nextPageIndex = getNextPageIndex(activePageIndex_);
+    std::size_t tailPageIndex = tailPageIndex_;
+    if (nextPageIndex == tailPageIndex && !isEmptyPage(configuration_.pages[nextPageIndex])) {
+      tailPageIndex = getNextPageIndex(tailPageIndex);
+    }
+    if (getNextPageIndex(nextPageIndex) == tailPageIndex) {
+      return tailPageIndex;
+    } else {
+      return kNumPages;
+    }
+  }
+
+  /**
+   * \brief Count the lines that the next switchPages() copies, given that it does not copy keys in visitor.
+   */
+  template <class Visitor>
+  std::size_t countReclaimedLines(const Visitor& visitor) const {
+    const std::size_t reclaimedPageIndex = getReclaimedPageIndex();
+    std::size_t numReclaimed = 0;
+    if (reclaimedPageIndex < kNumPages) {
+      visitReclaimedLines(reclaimedPageIndex, visitor,
+                          [&numReclaimed](const LinePtr_t linePtr) { numReclaimed += getEntryLines(*linePtr); });
+    }
+    return numReclaimed;
+  }
+
+  /**
+   * Continues writing on the next page of the ring, which is erased first if needed.
+   *
+   * If this leaves no erased page in the ring, the oldest page is compacted to the new active page and erased. Only
+   * the newest entry of each key is copied. Does not copy any line that the Visitor claims to contain, the caller
+   * writes those and then completes the compaction with compactAfterWrite().
+   *
+   * \return the Address of the first free line in the new page or the page end, if
+   *         the new page is full.
+   */
+  template <class Visitor>
+  LinePtr_t switchPages(const Visitor& visitor) {
+    // The page of a pending compaction is about to be reused.
+    finishCompaction();
+
+    const std::size_t nextPageIndex = getNextPageIndex(activePageIndex_);
+    const PagePtr_t nextPage = configuration_.pages[nextPageIndex];
+    const value_type generation = hasPageHeader(activePage()) ? getPageGeneration(activePage()) : 0;
+
+    FlashUnlock unlock;
+    closeActivePage();
+
+    if (!isEmptyPage(nextPage)) {
+      // Leftover of an interrupted page switch.
+      if (nextPageIndex == tailPageIndex_) {
+        tailPageIndex_ = getNextPageIndex(tailPageIndex_);
+        releaseLines(nextPageIndex);
+        publishView();
+      }
+      erasePage(nextPageIndex);
+    }
+
+    activePageIndex_ = nextPageIndex;
+    freeLine_ = getDataStart(nextPage);
+    const value_type nextGeneration = static_cast<value_type>((generation + 1u) & kValueMask);
+    writeHeaderLine(nextPage, kBeginLine, kPageBeginKey, nextGeneration);
 
-  PagePtr_t getInactivePage() {
-    if (activePage_ == configuration_.pages[0]) {
-      return configuration_.pages[1];
+    if (getNextPageIndex(activePageIndex_) != tailPageIndex_) {
+      writeHeaderLine(nextPage, kActiveLine, kPageActiveKey, nextGeneration);
+    } else if (kIncrementalCompaction) {
+      beginCompaction(visitor);
     } else {
-      return configuration_.pages[0];
+      const std::size_t reclaimedPageIndex = tailPageIndex_;
+      Trace_t::onCompactionBegin(configuration_.pages[reclaimedPageIndex]);
+      statistics_.countCompaction();
+      const LinePtr_t nextPageEnd = getPageEnd(nextPage);
+      LineWriter writer(*this);
+      visitReclaimedLines(reclaimedPageIndex, visitor, [this, nextPageEnd, &writer](const LinePtr_t linePtr) {
+        if (freeLine_ + getEntryLines(*linePtr) * kPtrLineIncrement <= nextPageEnd) {
+          copyEntryToActivePage(linePtr, writer);
+        }
+      });
+      writer.flush();
+
+      // The entries of visitor were not copied. Until the caller wrote them, the tail still holds their newest value,
+      // so the page only becomes active and the tail is only erased by compactAfterWrite().
+      compactionState_ = CompactionState::kCopying;
+      compactionLine_ = getDataEnd(reclaimedPageIndex);
+      compactionLinesLeft_ = 0;
+    }
+
+    return freeLine_;
+  }
+
+  /**
+   * \brief Locate the first free line of a page.
+   *
+   * Lines are only ever appended, so the free lines of a page form a contiguous tail. This allows for a binary search.
+   *
+   * \return the Address of the first free line or the page end, if the page is full.
+   */
+  static LinePtr_t findFreeLine(PagePtr_t page);
+
+  /**
+   * \brief Rebuild the key index from the contents of the ring.
+   */
+  void rebuildIndex();
+
+  /**
+   * \brief Abort a batch at the end of the active page that lacks its commit marker.
+   *
+   * Pads the unwritten entries of the batch and appends an abort marker, so that readers skip the whole batch.
+   */
+  void discardIncompleteBatch();
+
+  /// Lines have the layout of the format before page headers: a 16 bit key and a 16 bit value per word.
+  constexpr static const bool kLegacyLayout = kKeyBits == 16 && kValueBits == 16 && kLineBits == 32;
+
+  /**
+   * \brief Index of the page that holds the values of the format before page headers, or kNumPages if there is none.
+   *
+   * That format kept all values on one of the first two pages, the second one unless it was empty, starting at the
+   * first line of the page. A ring in which no page is active does not hold any values of the current format.
+   */
+  std::size_t findLegacyPage() const;
+
+  /**
+   * \brief Whether the newest values of all keys on a page of the format before page headers fit on a page with a
+   * header, and all keys are below kNumKeys.
+   */
+  bool canMigrateLegacyPage(const std::size_t legacyPageIndex) const;
+
+  /**
+   * \brief Copy the newest value of every key from a page of the format before page headers to a page with a header.
+   *
+   * All other pages are erased first and the legacy page is erased last. A power loss in between leaves a page that was
+   * never activated next to the legacy page, so the next initialize() migrates again. Requires
+   * canMigrateLegacyPage(), values are never dropped.
+   */
+  void migrateLegacyPage(const std::size_t legacyPageIndex);
+
+  /// Forget the ring in RAM, so that the store reads as empty and the first page is written next.
+  void clearRing();
+
+  PagePtr_t activePage() const { return configuration_.pages[activePageIndex_]; }
+
+  std::size_t numEntriesLeft(const View& view) const {
+    return static_cast<std::size_t>(getPageEnd(configuration_.pages[view.activePageIndex]) - view.freeLine) /
+           kPtrLineIncrement;
+  }
+
+  /// The ring as the writer sees it, including changes that are not published yet.
+  View writerView() const { return View{activePageIndex_, tailPageIndex_, freeLine_}; }
+
+  /// 8 bit active page index, 8 bit tail page index and the 16 bit line offset of the write cursor.
+  uint32_t packView(const View& view) const {
+    const PagePtr_t activePage = configuration_.pages[view.activePageIndex];
+    const std::size_t freeLineOffset = static_cast<std::size_t>(view.freeLine - activePage);
+    return static_cast<uint32_t>(view.activePageIndex | (view.tailPageIndex << 8) | (freeLineOffset << 16));
+  }
+
+  View unpackView(const uint32_t packedView) const {
+    const std::size_t activePageIndex = packedView & 0xFFu;
+    return View{activePageIndex, (packedView >> 8) & 0xFFu, configuration_.pages[activePageIndex] + (packedView >> 16)};
+  }
+
+  /**
+   * \brief Make all completed changes visible to concurrent readers.
+   */
+  void publishView() {
+    if (kConcurrentReads) {
+      readSync_.publish(packView(writerView()));
     }
   }
+
+  /**
+   * \brief Call reader(view) with a view of the ring that stays valid until it returns and return its result.
+   *
+   * Concurrent readers get the published view and repeat reader if a page was erased meanwhile.
+   */
+  template <class Reader>
+  auto readConsistently(Reader reader) const -> decltype(reader(View())) {
+    if (kConcurrentReads) {
+      return readSync_.read([this, &reader](const uint32_t packedView) { return reader(unpackView(packedView)); });
+    } else {
+      return reader(writerView());
+    }
+  }
+
+  /// Index of a line across all pages of the ring, as used by the key index.
+  std::size_t getLineIndex(const std::size_t pageIndex, const LinePtr_t linePtr) const {
+    const std::size_t lineInPage = static_cast<std::size_t>(linePtr - configuration_.pages[pageIndex]);
+    return (pageIndex * linesPerPage() + lineInPage) / kPtrLineIncrement;
+  }
+
+  LinePtr_t getLinePtr(const std::size_t lineIndex) const {
+    const std::size_t linePosition = lineIndex * kPtrLineIncrement;
+    return configuration_.pages[linePosition / linesPerPage()] + linePosition % linesPerPage();
+  }
+
+  constexpr static std::size_t getNextPageIndex(const std::size_t pageIndex) {
+    return (pageIndex + 1 == kNumPages) ? 0 : pageIndex + 1;
+  }
+
+  constexpr static std::size_t getPreviousPageIndex(const std::size_t pageIndex) {
+    return (pageIndex == 0) ? kNumPages - 1 : pageIndex - 1;
+  }
+
+  constexpr static bool isEmptyLine(const FlashLine_t line) { return line == kFreePattern; }
+
+  /// Whether line holds a value, as opposed to being empty, a control line or part of a record.
+  constexpr static bool isDataLine(const FlashLine_t line) { return GetKey(line) < kNumKeys; }
+
+  /// Whether line is the trailer of a record.
+  constexpr static bool isRecordLine(const FlashLine_t line) {
+    return kRecordsSupported && GetKey(line) >= kRecordKeyBase && GetKey(line) < kRecordKeyBase + kNumKeys;
+  }
+
+  /// Whether line carries record payload.
+  constexpr static bool isPayloadLine(const FlashLine_t line) {
+    return kRecordsSupported && (line >> (kLineBits - 2)) == 2u;
+  }
+
+  /// Whether line holds the newest state of a key: a value or a record trailer.
+  constexpr static bool isEntryLine(const FlashLine_t line) { return isDataLine(line) || isRecordLine(line); }
+
+  /// Key of a value line or a record trailer.
+  constexpr static key_type getEntryKey(const FlashLine_t line) {
+    return isRecordLine(line) ? static_cast<key_type>(GetKey(line) - kRecordKeyBase) : GetKey(line);
+  }
+
+  constexpr static std::size_t getPayloadLines(const std::size_t recordSize) {
+    return (recordSize + kRecordBytesPerLine - 1) / kRecordBytesPerLine;
+  }
+
+  /// Number of lines occupied by a value line or a record with the given trailer.
+  constexpr static std::size_t getEntryLines(const FlashLine_t line) {
+    return isRecordLine(line) ? getPayloadLines(GetValue(line)) + 1 : 1;
+  }
+
+  constexpr static FlashLine_t SetPayloadLine(const std::size_t sequence, const uint8_t* bytes, std::size_t numBytes);
+
+  /**
+   * \brief Compare size bytes of data with the payload of the record that ends with trailer.
+   */
+  static bool recordEquals(const LinePtr_t trailer, const void* data, const std::size_t size);
+
+  static bool isEmptyPage(const PagePtr_t page) {
+    // A page is empty if its first line is the free patern.
+    return isEmptyLine(*page);
+  }
+
+  constexpr static std::size_t linesPerPage() { return Config_t::pageSize / sizeof(FlashLine_t); }
+  constexpr static std::size_t dataLinesPerPage() { return linesPerPage() - kPageHeaderLines; }
+  static_assert(Config_t::pageSize / sizeof(FlashLine_t) > kPageHeaderLines, "Page too small for its header");
+
+  constexpr static LinePtr_t getDataStart(PagePtr_t page) { return page + kPageHeaderLines * kPtrLineIncrement; }
+
+  constexpr static LinePtr_t getPageEnd(PagePtr_t page) { return page + linesPerPage(); }
 };
 
+template <class TraitsT>
+constexpr const unsigned BasicFlashFairyPP<TraitsT>::kKeyBits;
+template <class TraitsT>
+constexpr const unsigned BasicFlashFairyPP<TraitsT>::kValueBits;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kKeyMask;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::value_type BasicFlashFairyPP<TraitsT>::kValueMask;
+template <class TraitsT>
+constexpr const size_t BasicFlashFairyPP<TraitsT>::kNumKeys;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::FlashLine_t BasicFlashFairyPP<TraitsT>::kFreePattern;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::value_type BasicFlashFairyPP<TraitsT>::npos;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kFirstControlKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kBatchBeginKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kBatchCommitKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kBatchAbortKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kBatchPaddingKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kPageBeginKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kPageActiveKey;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kPageClosedKey;
+template <class TraitsT>
+constexpr const unsigned BasicFlashFairyPP<TraitsT>::kLineBits;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kRecordBytesPerLine;
+template <class TraitsT>
+constexpr const typename BasicFlashFairyPP<TraitsT>::key_type BasicFlashFairyPP<TraitsT>::kRecordKeyBase;
+template <class TraitsT>
+constexpr const bool BasicFlashFairyPP<TraitsT>::kRecordsSupported;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kMaxRecordSize;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kPtrLineIncrement;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kNumPages;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kCompactionStepEntries;
+template <class TraitsT>
+constexpr const bool BasicFlashFairyPP<TraitsT>::kIncrementalCompaction;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kBulkProgramLines;
+template <class TraitsT>
+constexpr const bool BasicFlashFairyPP<TraitsT>::kConcurrentReads;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kFirstInPlaceKey;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kNumInPlaceKeys;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kPageHeaderLines;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kBeginLine;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kActiveLine;
+template <class TraitsT>
+constexpr const std::size_t BasicFlashFairyPP<TraitsT>::kClosedLine;
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::initialize(const Config_t& configuration) {
+  this->configuration_ = configuration;
+  statistics_.clear();
+
+  const std::size_t legacyPageIndex = findLegacyPage();
+  migrationRefused_ = legacyPageIndex < kNumPages && !canMigrateLegacyPage(legacyPageIndex);
+  if (migrationRefused_) {
+    // More keys than a page with a header holds, or keys out of range. Migrating would drop some of their values.
+    clearRing();
+    return false;
+  } else if (legacyPageIndex < kNumPages) {
+    migrateLegacyPage(legacyPageIndex);
+  }
+
+  // Pages are ordered by the generation in their header. The head is the page whose successor does not continue the
+  // generations, the tail is found by following them backwards.
+  bool hasHeader[kNumPages];
+  value_type generations[kNumPages];
+  for (std::size_t pageIndex = 0; pageIndex < kNumPages; ++pageIndex) {
+    const PagePtr_t page = configuration_.pages[pageIndex];
+    hasHeader[pageIndex] = hasPageHeader(page);
+    generations[pageIndex] = getPageGeneration(page);
+    if (!hasHeader[pageIndex] && !isEmptyPage(page)) {
+      // Not part of the ring and not migrated, e.g., foreign data. It would be overwritten later on.
+      FlashUnlock unlock;
+      erasePage(pageIndex);
+    }
+  }
+  auto continues = [&hasHeader, &generations](const std::size_t pageIndex, const std::size_t nextPageIndex) {
+    return hasHeader[pageIndex] && hasHeader[nextPageIndex] &&
+           generations[nextPageIndex] == ((generations[pageIndex] + 1u) & kValueMask);
+  };
+
+  activePageIndex_ = 0;
+  for (std::size_t pageIndex = 0; pageIndex < kNumPages; ++pageIndex) {
+    if (hasHeader[pageIndex] && !continues(pageIndex, getNextPageIndex(pageIndex))) {
+      activePageIndex_ = pageIndex;
+    }
+  }
+  tailPageIndex_ = activePageIndex_;
+  while (getPreviousPageIndex(tailPageIndex_) != activePageIndex_ &&
+         continues(getPreviousPageIndex(tailPageIndex_), tailPageIndex_)) {
+    tailPageIndex_ = getPreviousPageIndex(tailPageIndex_);
+  }
+
+  freeLine_ = hasHeader[activePageIndex_] ? findFreeLine(activePage()) : getDataStart(activePage());
+  compactionState_ = CompactionState::kIdle;
+  compactionLinesLeft_ = 0;
+  discardIncompleteBatch();
+  countLines();
+  rebuildIndex();
+
+  const bool ringFull = activePageIndex_ != tailPageIndex_ && getNextPageIndex(activePageIndex_) == tailPageIndex_;
+  if (hasHeader[activePageIndex_] && !isPageActive(activePage())) {
+    // Interrupted page switch. Entries that were copied before are no longer the newest and are not copied again.
+    if (ringFull) {
+      beginCompaction(NoKeys());
+    } else {
+      FlashUnlock unlock;
+      writeHeaderLine(activePage(), kActiveLine, kPageActiveKey, generations[activePageIndex_]);
+    }
+  } else if (ringFull) {
+    // All live entries of the tail were copied, it only needs to be erased.
+    compactionState_ = CompactionState::kErasing;
+  }
+  if (hasHeader[activePageIndex_] && isPageClosed(activePage())) {
+    // Interrupted page switch before the next page was started. Once the head is compacted, only its recorded data
+    // lines are read, so nothing may be appended to it. The switch is finished instead.
+    switchPages(NoKeys());
+  }
+  if (!kIncrementalCompaction) {
+    finishCompaction();
+  }
+  publishView();
+  return true;
+}
+
+template <class TraitsT>
+constexpr typename BasicFlashFairyPP<TraitsT>::FlashLine_t BasicFlashFairyPP<TraitsT>::SetPayloadLine(
+    const std::size_t sequence, const uint8_t* bytes, std::size_t numBytes) {
+  FlashLine_t line =
+      (static_cast<FlashLine_t>(2u) << (kLineBits - 2)) | (static_cast<FlashLine_t>(sequence) << (kLineBits - 8));
+  for (std::size_t i = 0; i < numBytes; ++i) {
+    line |= static_cast<FlashLine_t>(bytes[i]) << (8 * i);
+  }
+  return line;
+}
+
+template <class TraitsT>
+typename BasicFlashFairyPP<TraitsT>::value_type BasicFlashFairyPP<TraitsT>::getValue(const key_type key) const {
+  value_type result = npos;
+  findValue(key, result);
+  return result;
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::findValue(const key_type key, value_type& value) const {
+  if (KeyIndex_t::kEnabled) {
+    return index_.find(key, value, [this](const std::size_t lineIndex) {
+      statistics_.countScanned(1);
+      return GetValue(*getLinePtr(lineIndex));
+    });
+  } else {
+    const std::pair<bool, value_type> result = readConsistently([this, key](const View& view) {
+      std::pair<bool, value_type> found(false, 0);
+      visitLinesNewestFirst(view, [key, &found](const LinePtr_t linePtr, std::size_t) {
+        const FlashLine_t line = *linePtr;
+        if (getEntryKey(line) != key) {
+          return true;
+        } else if (isDataLine(line)) {
+          found = std::make_pair(true, GetValue(line));
+        }
+        return false;
+      });
+      return found;
+    });
+    if (result.first) {
+      value = result.second;
+    }
+    return result.first;
+  }
+}
+
+template <class TraitsT>
+std::size_t BasicFlashFairyPP<TraitsT>::loadValues(value_type* values, KeyBitmap_t& present) const {
+  return readConsistently([this, values, &present](const View& view) {
+    present = KeyBitmap_t();
+    std::size_t numLoaded = 0;
+    for (LiveEntryIterator entry(*this, view); entry != LiveEntryIterator(); ++entry) {
+      values[entry->first] = entry->second;
+      present.setBit(entry->first);
+      ++numLoaded;
+    }
+    return numLoaded;
+  });
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::setValue(const key_type key, const value_type value) {
+  std::size_t replacedLines = 0;
+  if (migrationRefused_ || key >= kNumKeys) {
+    return false;
+  } else if (isInPlaceKey(key) && setValueInPlace(key, value)) {
+    return true;
+  } else if (holdsValue(key, value, replacedLines)) {
+    statistics_.countSkippedWrite();
+    return true;
+  } else if (!storeVisitor(SingleElementVisitor(key, value))) {
+    return false;
+  }
+  numLiveLines_ = numLiveLines_ + 1 - replacedLines;
+  return true;
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::setRecord(const key_type key, const void* data, const std::size_t size) {
+  static_assert(kRecordsSupported, "Key range leaves no room for record trailers");
+  if (migrationRefused_ || key >= kNumKeys || size > kMaxRecordSize) {
+    return false;
+  }
+
+  bool unchanged = false;
+  std::size_t replacedLines = 0;
+  visitLinesNewestFirst([key, data, size, &unchanged, &replacedLines](const LinePtr_t linePtr, std::size_t) {
+    if (getEntryKey(*linePtr) != key) {
+      return true;
+    }
+    unchanged = isRecordLine(*linePtr) && GetValue(*linePtr) == size && recordEquals(linePtr, data, size);
+    replacedLines = getEntryLines(*linePtr);
+    return false;
+  });
+  if (unchanged) {
+    statistics_.countSkippedWrite();
+    return true;
+  }
+
+  const std::size_t payloadLines = getPayloadLines(size);
+  if (!reserveLines(payloadLines + 1, SingleElementVisitor(key, 0))) {
+    return false;
+  }
+
+  {
+    FlashUnlock unlock;
+    LineWriter writer(*this);
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (std::size_t sequence = 0; sequence < payloadLines; ++sequence) {
+      const std::size_t offset = sequence * kRecordBytesPerLine;
+      const std::size_t numBytes = (size - offset < kRecordBytesPerLine) ? size - offset : kRecordBytesPerLine;
+      writer.append(SetPayloadLine(sequence, bytes + offset, numBytes));
+    }
+    // The trailer makes the record visible.
+    writer.append(SetLine(static_cast<key_type>(kRecordKeyBase + key), static_cast<value_type>(size)));
+  }
+  index_.remove(key);
+  markWrittenDuringCompaction(key);
+  statistics_.countWrite(payloadLines + 1);
+  numLiveLines_ = numLiveLines_ + payloadLines + 1 - replacedLines;
+  compactAfterWrite();
+  return true;
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::getRecord(const key_type key, void* buffer, const std::size_t bufferSize,
+                                           std::size_t* recordSize) const {
+  const std::pair<bool, std::size_t> result = readConsistently([&](const View& view) {
+    std::pair<bool, std::size_t> found(false, 0);
+    visitLinesNewestFirst(view, [&](const LinePtr_t linePtr, const std::size_t pageIndex) {
+      const FlashLine_t line = *linePtr;
+      if (getEntryKey(line) != key) {
+        return true;
+      } else if (isRecordLine(line)) {
+        const std::size_t size = GetValue(line);
+        const std::size_t payloadLines = getPayloadLines(size);
+        if (payloadLines * kPtrLineIncrement >
+            static_cast<std::size_t>(linePtr - getDataStart(configuration_.pages[pageIndex]))) {
+          // Only seen by a concurrent read that overlaps with an erase, which is repeated.
+          return false;
+        }
+        const LinePtr_t payload = linePtr - payloadLines * kPtrLineIncrement;
+        uint8_t* bytes = static_cast<uint8_t*>(buffer);
+        for (std::size_t offset = 0; offset < size && offset < bufferSize; ++offset) {
+          const FlashLine_t payloadLine = payload[(offset / kRecordBytesPerLine) * kPtrLineIncrement];
+          bytes[offset] = static_cast<uint8_t>(payloadLine >> (8 * (offset % kRecordBytesPerLine)));
+        }
+        found = std::make_pair(true, size);
+      }
+      return false;
+    });
+    return found;
+  });
+  if (result.first && recordSize != nullptr) {
+    *recordSize = result.second;
+  }
+  return result.first;
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::recordEquals(const LinePtr_t trailer, const void* data, const std::size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  const std::size_t payloadLines = getPayloadLines(size);
+  for (std::size_t sequence = 0; sequence < payloadLines; ++sequence) {
+    const std::size_t offset = sequence * kRecordBytesPerLine;
+    const std::size_t numBytes = (size - offset < kRecordBytesPerLine) ? size - offset : kRecordBytesPerLine;
+    const LinePtr_t payloadLine = trailer - (payloadLines - sequence) * kPtrLineIncrement;
+    if (*payloadLine != SetPayloadLine(sequence, bytes + offset, numBytes)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <class TraitsT>
+std::size_t BasicFlashFairyPP<TraitsT>::countLiveKeys() const {
+  return readConsistently([this](const View& view) {
+    KeySet_t seen;
+    visitLinesNewestFirst(view, [&seen](const LinePtr_t linePtr, std::size_t) {
+      const FlashLine_t line = *linePtr;
+      if (isEntryLine(line)) {
+        seen.insert(getEntryKey(line));
+      }
+      return true;
+    });
+    return seen.size();
+  });
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::formatFlash() {
+  // Concurrent readers see an empty ring before any page is erased.
+  clearRing();
+  migrationRefused_ = false;
+  FlashUnlock unlock;
+  for (std::size_t pageIndex = 0; pageIndex < kNumPages; ++pageIndex) {
+    erasePage(pageIndex);
+  }
+  return true;
+}
+
+template <class TraitsT>
+void BasicFlashFairyPP<TraitsT>::clearRing() {
+  activePageIndex_ = 0;
+  tailPageIndex_ = 0;
+  freeLine_ = getDataStart(activePage());
+  index_.clear();
+  compactionState_ = CompactionState::kIdle;
+  compactionLinesLeft_ = 0;
+  numUsedLines_ = 0;
+  numLiveLines_ = 0;
+  publishView();
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::compactNow() {
+  if (migrationRefused_) {
+    return false;
+  }
+  finishCompaction();
+  if (reclaimableLines() == 0) {
+    return false;
+  }
+
+  std::size_t tailLiveLines = 0;
+  visitReclaimedLines(tailPageIndex_, NoKeys(),
+                      [&tailLiveLines](const LinePtr_t linePtr) { tailLiveLines += getEntryLines(*linePtr); });
+  if (tailPageIndex_ == activePageIndex_ || tailLiveLines > numEntriesLeft(writerView())) {
+    // Continue on the next page. If that leaves no erased page, switching pages compacts the tail.
+    const std::size_t tailPageIndex = tailPageIndex_;
+    switchPages(NoKeys());
+    finishCompaction();
+    if (tailPageIndex_ != tailPageIndex) {
+      publishView();
+      return true;
+    }
+  }
+
+  // The active page is not the tail and has room for the live entries of the tail.
+  const PagePtr_t tailPage = configuration_.pages[tailPageIndex_];
+  Trace_t::onCompactionBegin(tailPage);
+  statistics_.countCompaction();
+  {
+    FlashUnlock unlock;
+    LineWriter writer(*this);
+    visitReclaimedLines(tailPageIndex_, NoKeys(),
+                        [this, &writer](const LinePtr_t linePtr) { copyEntryToActivePage(linePtr, writer); });
+  }
+  Trace_t::onCompactionEnd(tailPage);
+  compactionState_ = CompactionState::kErasing;
+  finishCompaction();
+  publishView();
+  return true;
+}
+
+template <class TraitsT>
+void BasicFlashFairyPP<TraitsT>::rebuildIndex() {
+  index_.clear();
+  if (KeyIndex_t::kEnabled) {
+    visitLinesOldestFirst([this](const LinePtr_t linePtr, const std::size_t pageIndex) {
+      if (isDataLine(*linePtr)) {
+        index_.update(GetKey(*linePtr), GetValue(*linePtr), getLineIndex(pageIndex, linePtr));
+      } else {
+        index_.remove(getEntryKey(*linePtr));
+      }
+    });
+  }
+}
+
+template <class TraitsT>
+std::size_t BasicFlashFairyPP<TraitsT>::findLegacyPage() const {
+  if (!kLegacyLayout) {
+    return kNumPages;
+  }
+  for (std::size_t pageIndex = 0; pageIndex < kNumPages; ++pageIndex) {
+    const PagePtr_t page = configuration_.pages[pageIndex];
+    if (hasPageHeader(page) && isPageActive(page)) {
+      return kNumPages;
+    }
+  }
+  for (std::size_t pageIndex = 2; pageIndex-- > 0;) {
+    const PagePtr_t page = configuration_.pages[pageIndex];
+    if (!hasPageHeader(page) && !isEmptyPage(page)) {
+      return pageIndex;
+    }
+  }
+  return kNumPages;
+}
+
+template <class TraitsT>
+bool BasicFlashFairyPP<TraitsT>::canMigrateLegacyPage(const std::size_t legacyPageIndex) const {
+  const PagePtr_t legacyPage = configuration_.pages[legacyPageIndex];
+  KeySet_t seen;
+  std::size_t numKeys = 0;
+  for (LinePtr_t linePtr = legacyPage; linePtr < getPageEnd(legacyPage); linePtr += kPtrLineIncrement) {
+    const FlashLine_t line = *linePtr;
+    if (isEmptyLine(line)) {
+      continue;
+    } else if (GetKey(line) >= kNumKeys) {
+      return false;
+    } else if (seen.insert(GetKey(line))) {
+      ++numKeys;
+    }
+  }
+  return numKeys <= dataLinesPerPage();
+}
+
+template <class TraitsT>
+void BasicFlashFairyPP<TraitsT>::migrateLegacyPage(const std::size_t legacyPageIndex) {
+  const PagePtr_t legacyPage = configuration_.pages[legacyPageIndex];
+  const std::size_t targetPageIndex = (legacyPageIndex == 0) ? 1 : 0;
+  const PagePtr_t targetPage = configuration_.pages[targetPageIndex];
+
+  FlashUnlock unlock;
+  for (std::size_t pageIndex = 0; pageIndex < kNumPages; ++pageIndex) {
+    if (pageIndex != legacyPageIndex && !isEmptyPage(configuration_.pages[pageIndex])) {
+      erasePage(pageIndex);
+    }
+  }
+  writeHeaderLine(targetPage, kBeginLine, kPageBeginKey, 0);
+
+  // Any programmed line of the legacy page is a value, the newest one of a key is the last.
+  KeySet_t seen;
+  LinePtr_t targetLine = getDataStart(targetPage);
+  for (LinePtr_t linePtr = getPageEnd(legacyPage); linePtr > legacyPage;) {
+    linePtr -= kPtrLineIncrement;
+    const FlashLine_t line = *linePtr;
+    if (!isEmptyLine(line) && seen.insert(GetKey(line))) {
+      programLine(targetLine, line);
+      targetLine += kPtrLineIncrement;
+    }
+  }
+  writeHeaderLine(targetPage, kActiveLine, kPageActiveKey, 0);
+  erasePage(legacyPageIndex);
+}
+
+template <class TraitsT>
+void BasicFlashFairyPP<TraitsT>::discardIncompleteBatch() {
+  for (LinePtr_t linePtr = freeLine_; linePtr > getDataStart(activePage());) {
+    linePtr -= kPtrLineIncrement;
+    const key_type lineKey = GetKey(*linePtr);
+    if (lineKey == kBatchCommitKey || lineKey == kBatchAbortKey) {
+      return;
+    } else if (lineKey == kBatchBeginKey) {
+      // The newest batch was never committed. setValues() made sure that the whole batch fits into the page.
+      const value_type batchSize = GetValue(*linePtr);
+      const LinePtr_t batchEnd = linePtr + (batchSize + 1u) * kPtrLineIncrement;
+      FlashUnlock unlock;
+      while (freeLine_ < batchEnd) {
+        appendLine(SetLine(kBatchPaddingKey, 0));
+      }
+      appendLine(SetLine(kBatchAbortKey, batchSize));
+      return;
+    }
+  }
+}
+
+template <class TraitsT>
+typename BasicFlashFairyPP<TraitsT>::LinePtr_t BasicFlashFairyPP<TraitsT>::findFreeLine(PagePtr_t page) {
+  const LinePtr_t dataStart = getDataStart(page);
+  std::size_t first = 0;
+  std::size_t last = dataLinesPerPage();
+  while (first < last) {
+    const std::size_t middle = first + (last - first) / 2;
+    if (isEmptyLine(dataStart[middle * kPtrLineIncrement])) {
+      last = middle;
+    } else {
+      first = middle + 1;
+    }
+  }
+  return dataStart + first * kPtrLineIncrement;
+}
+
+template <class TraitsT>
+std::size_t BasicFlashFairyPP<TraitsT>::numEntriesLeftOnActivePage() const {
+  return readConsistently([this](const View& view) { return numEntriesLeft(view); });
+}
+
+using FlashFairyPP = BasicFlashFairyPP<>;
+
 }  // namespace FlashFairyPP
 
 #endif  // __FLASHFAIRYPP__FLASHFAIRYPP_H__
@@ -0,0 +1,85 @@
+#ifndef __FLASHFAIRYPP__FLASHHAL_H__
+#define __FLASHFAIRYPP__FLASHHAL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+extern "C" {
+void FlashFairy_Erase_Page(void* pagePtr);
+void FlashFairy_Write_Word(void* pagePtr, uint32_t line);
+/// Only needed for 64 bit lines. Programs a double-word in a single operation.
+void FlashFairy_Write_DoubleWord(void* pagePtr, uint64_t line);
+void flash_lock();
+void flash_unlock();
+}
+
+namespace FlashFairyPP {
+
+/*
+ * Flash backends for FlashFairyPP.
+ *
+ * A backend is a type with static member functions, so calls dispatch at compile time and can be inlined. Each
+ * backend provides:
+ *
+ *   unlock(), lock()                     - enable and disable programming and erasing. Calls are not nested.
+ *   erasePage(pagePtr)                   - set every byte of a page to 0xFF.
+ *   programLine(linePtr, line)           - program a single line. Overloaded for the line types in use, i.e.,
+ *                                          uint32_t and/or uint64_t.
+ *
+ * and may provide a bulk program operation:
+ *
+ *   kBulkProgramLines                    - maximum number of lines per programLines() call.
+ *   programLines(linePtr, lines, count)  - program count consecutive lines in ascending order.
+ *
+ * Lines that are programmed in bulk are collected in a buffer of kBulkProgramLines lines on the stack.
+ */
+
+/**
+ * \brief The default backend, which calls the C hooks FlashFairy_Erase_Page() and friends.
+ */
+struct CFlashHal {
+  static void unlock() { flash_unlock(); }
+  static void lock() { flash_lock(); }
+  static void erasePage(void* pagePtr) { FlashFairy_Erase_Page(pagePtr); }
+  static void programLine(void* linePtr, const uint32_t line) { FlashFairy_Write_Word(linePtr, line); }
+  static void programLine(void* linePtr, const uint64_t line) { FlashFairy_Write_DoubleWord(linePtr, line); }
+};
+
+template <typename...>
+struct MakeVoid {
+  using type = void;
+};
+
+/// Number of lines that FlashHal programs in bulk, 0 if it has no bulk program operation.
+template <class FlashHal, class = void>
+struct BulkProgramLines : std::integral_constant<std::size_t, 0> {};
+
+template <class FlashHal>
+struct BulkProgramLines<FlashHal, typename MakeVoid<decltype(FlashHal::kBulkProgramLines)>::type>
+    : std::integral_constant<std::size_t, FlashHal::kBulkProgramLines> {};
+
+/**
+ * \brief Program count consecutive lines, in bulk if FlashHal supports it.
+ */
+template <class FlashHal, typename Line>
+void ProgramLines(Line* linePtr, const Line* lines, const std::size_t count, std::true_type) {
+  FlashHal::programLines(linePtr, lines, count);
+}
+
+template <class FlashHal, typename Line>
+void ProgramLines(Line* linePtr, const Line* lines, const std::size_t count, std::false_type) {
+  for (std::size_t i = 0; i < count; ++i) {
+    FlashHal::programLine(linePtr + i, lines[i]);
+  }
+}
+
+template <class FlashHal, typename Line>
+void ProgramLines(Line* linePtr, const Line* lines, const std::size_t count) {
+  ProgramLines<FlashHal>(linePtr, lines, count,
+                         std::integral_constant<bool, (BulkProgramLines<FlashHal>::value > 0)>());
+}
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__FLASHHAL_H__
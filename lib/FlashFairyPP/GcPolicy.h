@@ -0,0 +1,65 @@
+#ifndef __FLASHFAIRYPP__GCPOLICY_H__
+#define __FLASHFAIRYPP__GCPOLICY_H__
+
+#include <cstddef>
+
+namespace FlashFairyPP {
+
+/**
+ * \brief Line usage of a ring, as tracked by FlashFairyPP since initialize(), see getLineCounts().
+ */
+struct LineCounts {
+  /// Lines that hold the newest entry of a key, i.e., values and records including their payload.
+  std::size_t numLiveLines;
+  /// Data lines that hold superseded entries, aborted batches or batch markers. Compaction reclaims them.
+  std::size_t numStaleLines;
+  /// Lines left on the active page.
+  std::size_t numFreeLines;
+  /// Data lines of all pages of the ring.
+  std::size_t numDataLines;
+};
+
+/*
+ * Garbage collection policies for FlashFairyPP.
+ *
+ * Without a policy, pages are only compacted when a write finds the active page full. poll() asks the policy whether
+ * to call compactNow() while no compaction is pending, so stale lines are reclaimed when the application is idle
+ * rather than during a write. Each policy provides:
+ *
+ *   shouldCompact(counts)            - whether to compact now, given the LineCounts of the ring.
+ */
+
+/**
+ * \brief Compact only when a write needs the space. The default.
+ */
+struct NoGcPolicy {
+  constexpr static bool shouldCompact(const LineCounts&) { return false; }
+};
+
+/**
+ * \brief Compact once at least Percent percent of the used lines, and at least MinStaleLines lines, are stale.
+ */
+template <std::size_t Percent, std::size_t MinStaleLines = 1>
+struct StaleRatioGcPolicy {
+  constexpr static bool shouldCompact(const LineCounts& counts) {
+    return counts.numStaleLines >= MinStaleLines &&
+           counts.numStaleLines * 100 >= Percent * (counts.numLiveLines + counts.numStaleLines);
+  }
+};
+
+/**
+ * \brief Keep at least MinFreeLines lines free on the active page, e.g., for a burst of writes that must not compact.
+ *
+ * Only compacts if the stale lines suffice to restore the headroom, so a ring that is mostly live is not compacted on
+ * every poll().
+ */
+template <std::size_t MinFreeLines>
+struct FreeLinesGcPolicy {
+  constexpr static bool shouldCompact(const LineCounts& counts) {
+    return counts.numFreeLines < MinFreeLines && counts.numFreeLines + counts.numStaleLines >= MinFreeLines;
+  }
+};
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__GCPOLICY_H__
@@ -0,0 +1,158 @@
+#ifndef __FLASHFAIRYPP__KEYINDEX_H__
+#define __FLASHFAIRYPP__KEYINDEX_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "FlashFairyPP/BitArray.h"
+
+namespace FlashFairyPP {
+
+/*
+ * Key index strategies for FlashFairyPP.
+ *
+ * An index is fed every (key, value, line) triple in the order in which the lines were written and answers lookups
+ * without scanning flash. Strategies are templates of the key and value types, the number of indexed keys, the number
+ * of pages of the ring and the number of lines per page. Line indexes address the ring, i.e., a line index is the page
+ * index times LinesPerPage plus the line within its page. Each strategy provides:
+ *
+ *   kEnabled                         - false if lookups must fall back to scanning the active page.
+ *   clear()                          - forget all keys.
+ *   update(key, value, line)         - key was written with value at line index line.
+ *   remove(key)                      - key no longer holds a value, e.g., because a record was written to it.
+ *   find(key, value, readValueAt)    - return whether key is present and store its value. readValueAt(line) reads the
+ *                                      value stored at a line index.
+ */
+
+/**
+ * \brief No index at all. Lookups scan flash, no RAM is used.
+ */
+template <typename Key, typename Value, std::size_t NumKeys, std::size_t NumPages, std::size_t LinesPerPage>
+class NoIndex {
+ public:
+  constexpr static const bool kEnabled = false;
+
+  void clear() {}
+  void update(const Key, const Value, const std::size_t) {}
+  void remove(const Key) {}
+
+  template <class ReadValueAt>
+  bool find(const Key, Value&, ReadValueAt) const {
+    return false;
+  }
+};
+
+/**
+ * \brief Keeps a RAM copy of the current value of every key.
+ *
+ * Costs NumKeys values plus a presence bitmap of RAM. Lookups never touch flash.
+ */
+template <typename Key, typename Value, std::size_t NumKeys, std::size_t NumPages, std::size_t LinesPerPage>
+class ValueCacheIndex {
+ public:
+  constexpr static const bool kEnabled = true;
+
+  void clear() { present_ = Presence_t(); }
+
+  void update(const Key key, const Value value, const std::size_t) {
+    if (key < NumKeys) {
+      values_[key] = value;
+      present_.setBit(key);
+    }
+  }
+
+  void remove(const Key key) {
+    if (key < NumKeys) {
+      present_.clearBit(key);
+    }
+  }
+
+  template <class ReadValueAt>
+  bool find(const Key key, Value& value, ReadValueAt) const {
+    if (key < NumKeys && present_.isSet(key)) {
+      value = values_[key];
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  using Presence_t = BitArray<uint32_t, NumKeys>;
+
+  Value values_[NumKeys];
+  Presence_t present_;
+};
+
+/**
+ * \brief Keeps a presence bitmap plus the page and the line within the page of the newest entry of every key.
+ *
+ * Misses are answered from the bitmap, hits cost a single flash read. The line within the page uses the smallest type
+ * that can address every line of a page, the page index takes as many bits per key as the number of pages needs. On
+ * pages of up to 256 lines, e.g., 1 KiB pages of words, a two-page ring with 16 bit values needs 320 bytes for 256
+ * keys, about 60% of the 544 bytes of ValueCacheIndex. Larger pages need 16 bit offsets, so with 16 bit values
+ * ValueCacheIndex is then smaller and needs no flash read.
+ */
+template <typename Key, typename Value, std::size_t NumKeys, std::size_t NumPages, std::size_t LinesPerPage>
+class PresenceHintIndex {
+ public:
+  constexpr static const bool kEnabled = true;
+
+  void clear() { present_ = Presence_t(); }
+
+  void update(const Key key, const Value, const std::size_t line) {
+    if (key < NumKeys) {
+      hints_[key] = static_cast<Offset_t>(line % LinesPerPage);
+      const std::size_t pageIndex = line / LinesPerPage;
+      for (unsigned bit = 0; bit < kPageBits; ++bit) {
+        if ((pageIndex >> bit) & 1u) {
+          pageBits_[bit].setBit(key);
+        } else {
+          pageBits_[bit].clearBit(key);
+        }
+      }
+      present_.setBit(key);
+    }
+  }
+
+  void remove(const Key key) {
+    if (key < NumKeys) {
+      present_.clearBit(key);
+    }
+  }
+
+  template <class ReadValueAt>
+  bool find(const Key key, Value& value, ReadValueAt readValueAt) const {
+    if (key < NumKeys && present_.isSet(key)) {
+      std::size_t pageIndex = 0;
+      for (unsigned bit = 0; bit < kPageBits; ++bit) {
+        pageIndex |= static_cast<std::size_t>(pageBits_[bit].isSet(key)) << bit;
+      }
+      value = readValueAt(pageIndex * LinesPerPage + hints_[key]);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  using Presence_t = BitArray<uint32_t, NumKeys>;
+  using Offset_t = typename std::conditional<(LinesPerPage <= 0x100), uint8_t, uint16_t>::type;
+  static_assert(LinesPerPage <= 0x10000, "PresenceHintIndex supports at most 65536 lines per page");
+
+  constexpr static unsigned bitsFor(const std::size_t numValues) {
+    return (numValues <= 1) ? 0 : 1 + bitsFor((numValues + 1) / 2);
+  }
+  /// Bits of the page index of a key, at least one so that the array below is not empty.
+  constexpr static const unsigned kPageBits = (bitsFor(NumPages) > 0) ? bitsFor(NumPages) : 1;
+
+  Offset_t hints_[NumKeys];
+  Presence_t pageBits_[kPageBits];
+  Presence_t present_;
+};
+
+template <typename Key, typename Value, std::size_t NumKeys, std::size_t NumPages, std::size_t LinesPerPage>
+constexpr const unsigned PresenceHintIndex<Key, Value, NumKeys, NumPages, LinesPerPage>::kPageBits;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__KEYINDEX_H__
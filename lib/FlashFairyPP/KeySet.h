@@ -0,0 +1,89 @@
+#ifndef __FLASHFAIRYPP__KEYSET_H__
+#define __FLASHFAIRYPP__KEYSET_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "FlashFairyPP/BitArray.h"
+
+namespace FlashFairyPP {
+
+/*
+ * Key set strategies for FlashFairyPP.
+ *
+ * Compaction and the deduplicating readers scan the ring newest first and remember which keys they have seen, so
+ * older entries of the same key are skipped. A key set lives on the stack for the duration of such a scan. A scan sees
+ * at most Capacity distinct keys, one per data line of the ring. Each strategy provides:
+ *
+ *   insert(key)                      - add key, return whether it was not contained before.
+ *   contains(key)                    - whether key was inserted.
+ *   size()                           - number of inserted keys.
+ */
+
+/**
+ * \brief One bit per key of the key space. Constant time, NumKeys / 8 bytes of RAM.
+ */
+template <typename Key, std::size_t NumKeys, std::size_t Capacity>
+class BitmapKeySet {
+ public:
+  bool insert(const Key key) {
+    if (bits_.isSet(key)) {
+      return false;
+    }
+    bits_.setBit(key);
+    ++size_;
+    return true;
+  }
+
+  bool contains(const Key key) const { return bits_.isSet(key); }
+  std::size_t size() const { return size_; }
+
+ private:
+  BitArray<uint32_t, NumKeys> bits_;
+  std::size_t size_ = 0;
+};
+
+/**
+ * \brief Sorted array of the inserted keys, for large and sparse key spaces.
+ *
+ * Needs Capacity keys of RAM whatever the size of the key space, i.e., it scales with the number of lines in the ring
+ * rather than the number of keys. Lookups are a binary search, an insert moves at most size() keys.
+ */
+template <typename Key, std::size_t NumKeys, std::size_t Capacity>
+class SortedKeySet {
+ public:
+  bool insert(const Key key) {
+    Key* const end = keys_ + size_;
+    Key* const position = std::lower_bound(keys_, end, key);
+    if (position != end && *position == key) {
+      return false;
+    }
+    std::copy_backward(position, end, end + 1);
+    *position = key;
+    ++size_;
+    return true;
+  }
+
+  bool contains(const Key key) const { return std::binary_search(keys_, keys_ + size_, key); }
+  std::size_t size() const { return size_; }
+
+ private:
+  Key keys_[Capacity];
+  std::size_t size_ = 0;
+};
+
+/**
+ * \brief Selects whichever of BitmapKeySet and SortedKeySet needs less RAM.
+ *
+ * The default key space of 256 keys uses a 32 byte bitmap, a 16 bit key space with 1 KiB pages a sorted array.
+ */
+template <typename Key, std::size_t NumKeys, std::size_t Capacity>
+using AutoKeySet = typename std::conditional<((NumKeys + 7) / 8 <= Capacity * sizeof(Key)),
+                                             BitmapKeySet<Key, NumKeys, Capacity>,
+                                             SortedKeySet<Key, NumKeys, Capacity>>::type;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__KEYSET_H__
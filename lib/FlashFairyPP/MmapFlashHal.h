@@ -0,0 +1,200 @@
+#ifndef __FLASHFAIRYPP__MMAPFLASHHAL_H__
+#define __FLASHFAIRYPP__MMAPFLASHHAL_H__
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace FlashFairyPP {
+
+/**
+ * \brief Flash pages in a memory-mapped file, for FlashFairyPP on Linux and other POSIX hosts.
+ *
+ * The file holds the pages one after another with the same layout as flash on an MCU, so images move between devices
+ * and hosts unchanged. Erasing and programming are stores to the mapping, programming only clears bits as on flash.
+ * Reads are plain loads from the page cache.
+ *
+ * sync() writes the modified part of the mapping back to the file with msync(MS_SYNC). MmapFlashHal calls it when the
+ * store locks flash, i.e., at the end of every setValue(), setValues() batch, setRecord(), page switch and compaction
+ * step, so each of them is durable once it returns.
+ *
+ * A file that is opened with kPrivate is mapped copy-on-write, e.g., to inspect an image: the store may recover or
+ * erase pages in memory, but the file is never modified.
+ */
+class MmapFlashFile {
+ public:
+  MmapFlashFile() = default;
+  MmapFlashFile(const MmapFlashFile&) = delete;
+  MmapFlashFile& operator=(const MmapFlashFile&) = delete;
+
+  ~MmapFlashFile() { close(); }
+
+  enum class Access {
+    /// Changes are written back to the file, a missing or empty file is created.
+    kReadWrite,
+    /// Changes stay in memory, the file must exist.
+    kPrivate,
+  };
+
+  /**
+   * \brief Map numPages pages of pageSize bytes. A missing or empty file is created with erased pages.
+   *
+   * If numPages is 0, the whole file is mapped, see numPages(). It must exist and its size must be a multiple of
+   * pageSize.
+   *
+   * \return false if the file cannot be mapped or its size does not match, see getLastError().
+   */
+  bool open(const char* path, const std::size_t pageSize, const std::size_t numPages,
+            const Access access = Access::kReadWrite) {
+    close();
+    shared_ = access == Access::kReadWrite;
+    pageSize_ = pageSize;
+    size_ = pageSize * numPages;
+    fd_ = shared_ ? ::open(path, O_RDWR | ((numPages > 0) ? O_CREAT : 0), 0644) : ::open(path, O_RDONLY);
+    struct stat status;
+    if (fd_ < 0 || fstat(fd_, &status) != 0) {
+      return fail();
+    }
+    const std::size_t fileSize = static_cast<std::size_t>(status.st_size);
+    if (numPages == 0 && pageSize > 0 && fileSize % pageSize == 0) {
+      size_ = fileSize;
+    }
+    const bool created = shared_ && fileSize == 0 && size_ > 0;
+    if (created) {
+      if (ftruncate(fd_, static_cast<off_t>(size_)) != 0) {
+        return fail();
+      }
+    } else if (fileSize != size_ || size_ == 0) {
+      errno = EINVAL;
+      return fail();
+    }
+
+    void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, shared_ ? MAP_SHARED : MAP_PRIVATE, fd_, 0);
+    if (data == MAP_FAILED) {
+      return fail();
+    }
+    data_ = static_cast<uint8_t*>(data);
+    if (created) {
+      memset(data_, 0xFF, size_);
+      markDirty(data_, size_);
+      // The file size is metadata that msync() does not cover.
+      if (!sync() || fdatasync(fd_) != 0) {
+        return fail();
+      }
+    }
+    return true;
+  }
+
+  /// Write back pending changes and unmap the file.
+  void close() {
+    if (data_ != nullptr) {
+      sync();
+      munmap(data_, size_);
+      data_ = nullptr;
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  bool isOpen() const { return data_ != nullptr; }
+  std::size_t numPages() const { return (pageSize_ > 0) ? size_ / pageSize_ : 0; }
+  uint8_t* page(const std::size_t pageIndex) const { return data_ + pageIndex * pageSize_; }
+
+  void erasePage(void* pagePtr) {
+    memset(pagePtr, 0xFF, pageSize_);
+    markDirty(pagePtr, pageSize_);
+  }
+
+  template <typename Line>
+  void program(void* linePtr, const Line line) {
+    Line stored;
+    memcpy(&stored, linePtr, sizeof(Line));
+    stored &= line;
+    memcpy(linePtr, &stored, sizeof(Line));
+    markDirty(linePtr, sizeof(Line));
+  }
+
+  /**
+   * \brief Write the modified pages of the mapping back to the file.
+   *
+   * \return false if msync() failed. The range stays dirty and is written by the next sync().
+   */
+  bool sync() {
+    if (dirtyBegin_ >= dirtyEnd_ || !shared_) {
+      return true;
+    }
+    // msync() needs an address aligned to the system page size.
+    const std::size_t systemPageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t begin = dirtyBegin_ / systemPageSize * systemPageSize;
+    if (msync(data_ + begin, dirtyEnd_ - begin, MS_SYNC) != 0) {
+      lastError_ = errno;
+      ++numSyncFailures_;
+      return false;
+    }
+    dirtyBegin_ = static_cast<std::size_t>(-1);
+    dirtyEnd_ = 0;
+    ++numSyncs_;
+    return true;
+  }
+
+  /// errno of the last failed operation.
+  int getLastError() const { return lastError_; }
+  std::size_t numSyncs() const { return numSyncs_; }
+  std::size_t numSyncFailures() const { return numSyncFailures_; }
+
+ private:
+  void markDirty(const void* ptr, const std::size_t size) {
+    const std::size_t offset = static_cast<std::size_t>(static_cast<const uint8_t*>(ptr) - data_);
+    dirtyBegin_ = (offset < dirtyBegin_) ? offset : dirtyBegin_;
+    dirtyEnd_ = (offset + size > dirtyEnd_) ? offset + size : dirtyEnd_;
+  }
+
+  bool fail() {
+    lastError_ = errno;
+    close();
+    return false;
+  }
+
+  int fd_ = -1;
+  bool shared_ = true;
+  uint8_t* data_ = nullptr;
+  std::size_t pageSize_ = 0;
+  std::size_t size_ = 0;
+  std::size_t dirtyBegin_ = static_cast<std::size_t>(-1);
+  std::size_t dirtyEnd_ = 0;
+  int lastError_ = 0;
+  std::size_t numSyncs_ = 0;
+  std::size_t numSyncFailures_ = 0;
+};
+
+/**
+ * \brief Flash backend, see FlashHal.h, that runs on an MmapFlashFile. Every lock() is a durability point.
+ *
+ * Backends are stateless, so the file is selected through a static pointer. Tag tells apart backends of stores that
+ * use different files.
+ */
+template <class Tag = void>
+struct MmapFlashHal {
+  static MmapFlashFile* file;
+
+  static void unlock() {}
+  static void lock() { file->sync(); }
+  static void erasePage(void* pagePtr) { file->erasePage(pagePtr); }
+  static void programLine(void* linePtr, const uint32_t line) { file->program(linePtr, line); }
+  static void programLine(void* linePtr, const uint64_t line) { file->program(linePtr, line); }
+};
+
+template <class Tag>
+MmapFlashFile* MmapFlashHal<Tag>::file = nullptr;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__MMAPFLASHHAL_H__
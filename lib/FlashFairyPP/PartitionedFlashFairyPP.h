@@ -0,0 +1,195 @@
+#ifndef __FLASHFAIRYPP__PARTITIONEDFLASHFAIRYPP_H__
+#define __FLASHFAIRYPP__PARTITIONEDFLASHFAIRYPP_H__
+
+#include <cstddef>
+#include <type_traits>
+
+#include "FlashFairyPP/FlashFairyPP.h"
+
+namespace FlashFairyPP {
+
+/**
+ * \brief Key class of the keys in [First, First + Count), e.g., the hot keys of a PartitionedFlashFairyPP.
+ */
+template <std::size_t First, std::size_t Count>
+struct KeyRange {
+  constexpr static bool contains(const std::size_t key) { return key >= First && key - First < Count; }
+};
+
+/**
+ * \brief A store whose keys are split into a hot and a cold partition, each on its own group of pages.
+ *
+ * Every key is routed to a single partition at compile time: keys for which HotKeys::contains(key) is true to a
+ * BasicFlashFairyPP<HotTraitsT>, all others to a BasicFlashFairyPP<ColdTraitsT>. Each partition fills, compacts and
+ * erases its own pages, so churn on a few hot keys only copies the hot live set when switching pages, while cold keys,
+ * e.g., calibration data, stay where they are. Reads only scan the partition of their key.
+ *
+ * Both traits must use the same key space and line layout; page size, number of pages, key index, compaction step and
+ * flash backend may differ, e.g., a ValueCacheIndex for the hot keys only. HotKeys is a type with a constexpr static
+ * contains(key), such as KeyRange.
+ */
+template <class HotTraitsT, class ColdTraitsT, class HotKeys>
+class PartitionedFlashFairyPP {
+ public:
+  using Hot_t = BasicFlashFairyPP<HotTraitsT>;
+  using Cold_t = BasicFlashFairyPP<ColdTraitsT>;
+
+  using key_type = typename Cold_t::key_type;
+  using value_type = typename Cold_t::value_type;
+  static_assert(Hot_t::kNumKeys == Cold_t::kNumKeys && Hot_t::kKeyBits == Cold_t::kKeyBits &&
+                    Hot_t::kValueBits == Cold_t::kValueBits,
+                "Partitions must share the key space");
+
+  constexpr static const std::size_t kNumKeys = Cold_t::kNumKeys;
+  constexpr static const value_type npos = Cold_t::npos;
+
+  using KeyBitmap_t = typename Cold_t::KeyBitmap_t;
+
+  template <std::size_t Capacity>
+  using WriteBatch = typename Cold_t::template WriteBatch<Capacity>;
+
+  /// The pages of both partitions.
+  struct Config_t {
+    typename Hot_t::Config_t hot;
+    typename Cold_t::Config_t cold;
+  };
+
+  constexpr static bool isHotKey(const key_type key) { return HotKeys::contains(key); }
+
+  /**
+   * \brief Initialize both partitions for their memory areas.
+   */
+  bool initialize(const Config_t& configuration) {
+    const bool hotInitialized = hot_.initialize(configuration.hot);
+    return cold_.initialize(configuration.cold) && hotInitialized;
+  }
+
+  /**
+   * \return The stored value or npos, if the key was never written.
+   */
+  value_type getValue(const key_type key) const { return isHotKey(key) ? hot_.getValue(key) : cold_.getValue(key); }
+
+  bool findValue(const key_type key, value_type& value) const {
+    return isHotKey(key) ? hot_.findValue(key, value) : cold_.findValue(key, value);
+  }
+
+  template <typename V>
+  bool readValueIfAvailable(const key_type key, V& value) const {
+    return isHotKey(key) ? hot_.readValueIfAvailable(key, value) : cold_.readValueIfAvailable(key, value);
+  }
+
+  bool setValue(const key_type key, const value_type value) {
+    return isHotKey(key) ? hot_.setValue(key, value) : cold_.setValue(key, value);
+  }
+
+  bool setRecord(const key_type key, const void* data, const std::size_t size) {
+    return isHotKey(key) ? hot_.setRecord(key, data, size) : cold_.setRecord(key, data, size);
+  }
+
+  template <typename T>
+  bool setRecord(const key_type key, const T& value) {
+    return isHotKey(key) ? hot_.setRecord(key, value) : cold_.setRecord(key, value);
+  }
+
+  bool getRecord(const key_type key, void* buffer, const std::size_t bufferSize,
+                 std::size_t* recordSize = nullptr) const {
+    return isHotKey(key) ? hot_.getRecord(key, buffer, bufferSize, recordSize)
+                         : cold_.getRecord(key, buffer, bufferSize, recordSize);
+  }
+
+  template <typename T>
+  bool getRecord(const key_type key, T& value) const {
+    return isHotKey(key) ? hot_.getRecord(key, value) : cold_.getRecord(key, value);
+  }
+
+  /**
+   * \brief Commit a batch of the keys of a single partition as a whole, see BasicFlashFairyPP::setValues().
+   *
+   * Each partition commits on its own pages, so a batch that spans both partitions could not be committed atomically.
+   *
+   * \return false without modifying flash if the batch holds hot and cold keys, otherwise whether it was stored.
+   */
+  template <std::size_t Capacity>
+  bool setValues(const WriteBatch<Capacity>& batch) {
+    typename Hot_t::template WriteBatch<Capacity> hotBatch;
+    typename Cold_t::template WriteBatch<Capacity> coldBatch;
+    for (const auto& entry : batch) {
+      if (isHotKey(entry.first)) {
+        hotBatch.setValue(entry.first, entry.second);
+      } else {
+        coldBatch.setValue(entry.first, entry.second);
+      }
+    }
+    if (!hotBatch.empty() && !coldBatch.empty()) {
+      return false;
+    }
+    return hotBatch.empty() ? cold_.setValues(coldBatch) : hot_.setValues(hotBatch);
+  }
+
+  /**
+   * \brief Read the latest value of every key of both partitions, see BasicFlashFairyPP::loadValues().
+   */
+  std::size_t loadValues(value_type* values, KeyBitmap_t& present) const {
+    KeyBitmap_t coldPresent;
+    const std::size_t numLoaded = hot_.loadValues(values, present) + cold_.loadValues(values, coldPresent);
+    for (std::size_t key = 0; key < kNumKeys; ++key) {
+      if (coldPresent.isSet(key)) {
+        present.setBit(key);
+      }
+    }
+    return numLoaded;
+  }
+
+  template <std::size_t N>
+  std::size_t loadValues(value_type (&values)[N], KeyBitmap_t& present) const {
+    static_assert(N >= kNumKeys, "values must hold kNumKeys elements");
+    return loadValues(&values[0], present);
+  }
+
+  /**
+   * \brief Call visitor(key, value) for the values of the hot partition, then for those of the cold partition, see
+   * BasicFlashFairyPP::visitEntries().
+   */
+  template <class Visitor>
+  void visitEntries(Visitor& visitor) const {
+    hot_.visitEntries(visitor);
+    cold_.visitEntries(visitor);
+  }
+
+  /**
+   * \brief Advance pending incremental compactions of both partitions by one step each.
+   *
+   * \return Whether a compaction is still pending.
+   */
+  bool poll() {
+    const bool hotPending = hot_.poll();
+    return cold_.poll() || hotPending;
+  }
+
+  bool isCompactionPending() const { return hot_.isCompactionPending() || cold_.isCompactionPending(); }
+
+  bool formatFlash() {
+    const bool hotFormatted = hot_.formatFlash();
+    return cold_.formatFlash() && hotFormatted;
+  }
+
+  std::size_t countLiveKeys() const { return hot_.countLiveKeys() + cold_.countLiveKeys(); }
+
+  /// The partitions, e.g., for their statistics. Writes must go through the PartitionedFlashFairyPP.
+  const Hot_t& hot() const { return hot_; }
+  const Cold_t& cold() const { return cold_; }
+
+ private:
+  Hot_t hot_;
+  Cold_t cold_;
+};
+
+template <class HotTraitsT, class ColdTraitsT, class HotKeys>
+constexpr const std::size_t PartitionedFlashFairyPP<HotTraitsT, ColdTraitsT, HotKeys>::kNumKeys;
+template <class HotTraitsT, class ColdTraitsT, class HotKeys>
+constexpr const typename PartitionedFlashFairyPP<HotTraitsT, ColdTraitsT, HotKeys>::value_type
+    PartitionedFlashFairyPP<HotTraitsT, ColdTraitsT, HotKeys>::npos;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__PARTITIONEDFLASHFAIRYPP_H__
@@ -0,0 +1,80 @@
+#ifndef __FLASHFAIRYPP__READSYNC_H__
+#define __FLASHFAIRYPP__READSYNC_H__
+
+#include <atomic>
+#include <cstdint>
+
+namespace FlashFairyPP {
+
+/*
+ * Read synchronization strategies for FlashFairyPP.
+ *
+ * With concurrent reads, readers in other threads, RTOS tasks or ISRs never look at the state that the single writer
+ * changes while it works. Instead, the writer publishes a packed view of the ring (active page, tail page and write
+ * cursor) once all lines within it are complete. A page leaves the published view before it is erased, and every
+ * erase advances a sequence counter. A reader that scanned while an erase started may have seen the page being
+ * erased in its older view, so it scans again. Each strategy provides:
+ *
+ *   kEnabled                         - false if only the writer reads.
+ *   publish(view)                    - make view visible to readers, including all lines written before.
+ *   beginErase()                     - a page that left the published view is about to be erased.
+ *   read(reader)                     - call reader(view) until no erase started during the call, return its result.
+ */
+
+/**
+ * \brief Reads and writes from a single thread. No synchronization, no RAM.
+ */
+class NoReadSync {
+ public:
+  constexpr static const bool kEnabled = false;
+
+  void publish(const uint32_t) {}
+  void beginErase() {}
+
+  template <class Reader>
+  auto read(Reader reader) const -> decltype(reader(0u)) {
+    return reader(0u);
+  }
+};
+
+/**
+ * \brief Lock-free readers with a sequence counter of erases.
+ *
+ * Readers never wait for the writer, e.g., an ISR that interrupts an erase reads the view published before. A read
+ * only repeats if an erase started while it was scanning. Writes must still be serialized by the caller. Needs
+ * lock-free 32 bit atomic loads and stores only.
+ */
+class SeqLockReadSync {
+ public:
+  constexpr static const bool kEnabled = true;
+
+  void publish(const uint32_t view) { view_.store(view, std::memory_order_release); }
+
+  void beginErase() {
+    // Only the writer modifies the counter, so no read-modify-write is needed. The release store orders the increment
+    // after the view that was published before, so a reader that sees the new sequence also sees the new view. The
+    // fence keeps the erase from moving ahead of the increment.
+    sequence_.store(sequence_.load(std::memory_order_relaxed) + 1u, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+
+  template <class Reader>
+  auto read(Reader reader) const -> decltype(reader(0u)) {
+    while (true) {
+      const uint32_t sequence = sequence_.load(std::memory_order_acquire);
+      const auto result = reader(view_.load(std::memory_order_acquire));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) == sequence) {
+        return result;
+      }
+    }
+  }
+
+ private:
+  std::atomic<uint32_t> view_{0};
+  std::atomic<uint32_t> sequence_{0};
+};
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__READSYNC_H__
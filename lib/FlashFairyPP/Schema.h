@@ -0,0 +1,215 @@
+#ifndef __FLASHFAIRYPP__SCHEMA_H__
+#define __FLASHFAIRYPP__SCHEMA_H__
+
+#include <cstddef>
+#include <type_traits>
+
+namespace FlashFairyPP {
+
+/**
+ * \brief A setting of a Schema: its key, C++ type and default value.
+ *
+ * T is an integral, enum or bool type. Declare each setting once as its own type, e.g.,
+ * struct Brightness : Setting<1, uint8_t, 128> {};
+ */
+template <std::size_t Key, typename T, T Default = T()>
+struct Setting {
+  using type = T;
+  constexpr static const std::size_t kKey = Key;
+  constexpr static T defaultValue() { return Default; }
+};
+
+/**
+ * \brief A setting of a trivially copyable type, e.g., a struct of calibration data, that is stored as a record.
+ *
+ * The default is a value-initialized T. Shadow defaultValue() in the declaration for another default.
+ */
+template <std::size_t Key, typename T>
+struct RecordSetting {
+  using type = T;
+  constexpr static const std::size_t kKey = Key;
+  static T defaultValue() { return T(); }
+};
+
+template <std::size_t Key, typename T, T Default>
+constexpr const std::size_t Setting<Key, T, Default>::kKey;
+template <std::size_t Key, typename T>
+constexpr const std::size_t RecordSetting<Key, T>::kKey;
+
+/// Stored representation of a setting type: the unsigned type of integers and enums, the type itself otherwise.
+template <typename T, bool IsEnum = std::is_enum<T>::value,
+          bool IsInteger = std::is_integral<T>::value && !std::is_same<T, bool>::value>
+struct SettingRepr {
+  using type = T;
+};
+
+template <typename T>
+struct SettingRepr<T, true, false> {
+  using type = typename std::make_unsigned<typename std::underlying_type<T>::type>::type;
+};
+
+template <typename T>
+struct SettingRepr<T, false, true> {
+  using type = typename std::make_unsigned<T>::type;
+};
+
+/**
+ * \brief Typed accessors for a fixed set of settings of a FlashFairyT, e.g., a BasicFlashFairyPP.
+ *
+ * All settings are declared in one place, e.g.,
+ * using AppSettings = Schema<FlashFairyPP, Brightness, Mode, Calibration>;
+ * and read and written as settings.get<Brightness>() and settings.set<Brightness>(200). Everything that depends on the
+ * setting is resolved at compile time: keys must be distinct and in range of the store, a setting that is not part of
+ * the schema does not compile, and integral, enum and bool settings that fit into kValueBits are stored as a single
+ * value line while all other settings are stored as records. Signed values are stored as their unsigned
+ * representation.
+ *
+ * Defaults are never written to flash. get() returns the default of a setting that was never written, or that holds
+ * an entry of another type, e.g., after a firmware update changed the layout of a record.
+ */
+template <class FlashFairyT, class... SettingsT>
+class Schema {
+ public:
+  using value_type = typename FlashFairyT::value_type;
+
+  constexpr static const std::size_t kNumSettings = sizeof...(SettingsT);
+
+  explicit Schema(FlashFairyT& flashFairy) : flashFairy_(flashFairy) {
+    static_assert(hasDistinctKeys(), "Settings must have distinct keys");
+    static_assert(hasKeysInRange(), "Setting keys must be less than kNumKeys");
+    static_assert(hasStorableTypes(), "Settings must fit into a value or a record of the store");
+  }
+
+  /// Whether no two settings share a key. Checked when a Schema is constructed, like the following checks.
+  constexpr static bool hasDistinctKeys() {
+    const std::size_t keys[] = {0, SettingsT::kKey...};
+    for (std::size_t i = 1; i <= kNumSettings; ++i) {
+      for (std::size_t j = i + 1; j <= kNumSettings; ++j) {
+        if (keys[i] == keys[j]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  constexpr static bool hasKeysInRange() {
+    const bool inRange[] = {true, (SettingsT::kKey < FlashFairyT::kNumKeys)...};
+    for (const bool keyInRange : inRange) {
+      if (!keyInRange) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Whether every setting is a value, or a trivially copyable record the store can hold.
+  constexpr static bool hasStorableTypes() {
+    const bool storable[] = {true, (isStoredAsValue<SettingsT>() ||
+                                    (std::is_trivially_copyable<typename SettingsT::type>::value &&
+                                     FlashFairyT::kRecordsSupported &&
+                                     sizeof(typename SettingsT::type) <= FlashFairyT::kMaxRecordSize))...};
+    for (const bool settingStorable : storable) {
+      if (!settingStorable) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Whether SettingT is part of this schema.
+  template <class SettingT>
+  constexpr static bool contains() {
+    const bool matches[] = {false, std::is_same<SettingT, SettingsT>::value...};
+    for (const bool match : matches) {
+      if (match) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Whether a setting is stored as a single value line rather than as a record.
+  template <class SettingT>
+  constexpr static bool isStoredAsValue() {
+    using Stored_t = typename SettingRepr<typename SettingT::type>::type;
+    return std::is_integral<Stored_t>::value &&
+           (std::is_same<Stored_t, bool>::value ? 1 : sizeof(Stored_t) * 8) <= FlashFairyT::kValueBits;
+  }
+
+  /**
+   * \return The stored value of SettingT, or its default.
+   */
+  template <class SettingT>
+  typename SettingT::type get() const {
+    typename SettingT::type value = SettingT::defaultValue();
+    find<SettingT>(value);
+    return value;
+  }
+
+  /**
+   * \brief Read the stored value of SettingT.
+   *
+   * \return Whether a value of SettingT was stored. value is only modified if it was.
+   */
+  template <class SettingT>
+  bool find(typename SettingT::type& value) const {
+    static_assert(contains<SettingT>(), "Setting is not part of the schema");
+    return find<SettingT>(value, std::integral_constant<bool, isStoredAsValue<SettingT>()>());
+  }
+
+  /**
+   * \brief Commit a new value of SettingT, see BasicFlashFairyPP::setValue() and BasicFlashFairyPP::setRecord().
+   */
+  template <class SettingT>
+  bool set(const typename SettingT::type& value) {
+    static_assert(contains<SettingT>(), "Setting is not part of the schema");
+    return set<SettingT>(value, std::integral_constant<bool, isStoredAsValue<SettingT>()>());
+  }
+
+  /// The default of SettingT, without reading flash.
+  template <class SettingT>
+  constexpr static typename SettingT::type defaultValue() {
+    static_assert(contains<SettingT>(), "Setting is not part of the schema");
+    return SettingT::defaultValue();
+  }
+
+ private:
+  template <class SettingT>
+  using Repr_t = typename SettingRepr<typename SettingT::type>::type;
+
+  template <class SettingT>
+  bool find(typename SettingT::type& value, std::true_type) const {
+    value_type storedValue;
+    if (!flashFairy_.findValue(static_cast<typename FlashFairyT::key_type>(SettingT::kKey), storedValue)) {
+      return false;
+    }
+    value = static_cast<typename SettingT::type>(static_cast<Repr_t<SettingT>>(storedValue));
+    return true;
+  }
+
+  template <class SettingT>
+  bool find(typename SettingT::type& value, std::false_type) const {
+    return flashFairy_.getRecord(static_cast<typename FlashFairyT::key_type>(SettingT::kKey), value);
+  }
+
+  template <class SettingT>
+  bool set(const typename SettingT::type& value, std::true_type) {
+    return flashFairy_.setValue(static_cast<typename FlashFairyT::key_type>(SettingT::kKey),
+                                static_cast<value_type>(static_cast<Repr_t<SettingT>>(value)));
+  }
+
+  template <class SettingT>
+  bool set(const typename SettingT::type& value, std::false_type) {
+    return flashFairy_.setRecord(static_cast<typename FlashFairyT::key_type>(SettingT::kKey), value);
+  }
+
+  FlashFairyT& flashFairy_;
+};
+
+template <class FlashFairyT, class... SettingsT>
+constexpr const std::size_t Schema<FlashFairyT, SettingsT...>::kNumSettings;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__SCHEMA_H__
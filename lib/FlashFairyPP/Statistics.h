@@ -0,0 +1,116 @@
+#ifndef __FLASHFAIRYPP__STATISTICS_H__
+#define __FLASHFAIRYPP__STATISTICS_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace FlashFairyPP {
+
+/*
+ * Statistics strategies for FlashFairyPP.
+ *
+ * A strategy is told about every operation of a store and decides what to keep. Counters start at zero on
+ * initialize() and count operations since then. Each strategy provides:
+ *
+ *   kEnabled                         - false if nothing is counted.
+ *   clear()                          - reset all counters.
+ *   countWrite(userLines)            - a write stored userLines lines of user data, e.g., 1 for setValue().
+ *   countSkippedWrite()              - a write was skipped because the stored value was identical.
+ *   countProgrammed(numLines)        - numLines lines were programmed, including headers, markers and copies.
+ *   countCopied(numLines)            - compaction copied numLines lines.
+ *   countCompaction()                - compaction of the oldest page started.
+ *   countErase(pageIndex)            - a page was erased.
+ *   countScanned(numLines)           - numLines lines were read while looking for entries.
+ */
+
+/**
+ * \brief Counts nothing. Uses neither RAM nor time.
+ */
+template <std::size_t NumPages>
+class NoStatistics {
+ public:
+  constexpr static const bool kEnabled = false;
+
+  void clear() {}
+  void countWrite(const std::size_t) {}
+  void countSkippedWrite() {}
+  void countProgrammed(const std::size_t) {}
+  void countCopied(const std::size_t) {}
+  void countCompaction() {}
+  void countErase(const std::size_t) {}
+  void countScanned(const std::size_t) const {}
+};
+
+/**
+ * \brief Operation counters, e.g., to be exported over a diagnostics channel.
+ */
+template <std::size_t NumPages>
+class Statistics {
+ public:
+  constexpr static const bool kEnabled = true;
+
+  /// Writes that stored data, i.e., setValue(), setValues() and setRecord() calls that programmed flash.
+  uint32_t numWrites = 0;
+  /// Writes that did not program flash, because the stored data was identical.
+  uint32_t numSkippedWrites = 0;
+  /// Lines of user data that writes stored.
+  uint32_t numUserLines = 0;
+  /// All programmed lines: user data, batch markers, page headers and copies.
+  uint32_t numProgrammedLines = 0;
+  /// Lines that compaction copied.
+  uint32_t numCopiedLines = 0;
+  /// Compactions of the oldest page.
+  uint32_t numCompactions = 0;
+  /// Page erases, in total and per page.
+  uint32_t numErases = 0;
+  uint32_t numErasesPerPage[NumPages] = {};
+  /// Lines that reads, writes and compaction scanned.
+  mutable uint32_t numScannedLines = 0;
+
+  /**
+   * \brief Programmed lines per line of user data, 0 if nothing was written yet.
+   */
+  float writeAmplification() const {
+    return (numUserLines > 0) ? static_cast<float>(numProgrammedLines) / static_cast<float>(numUserLines) : 0.0f;
+  }
+
+  void clear() { *this = Statistics(); }
+  void countWrite(const std::size_t userLines) {
+    ++numWrites;
+    numUserLines += static_cast<uint32_t>(userLines);
+  }
+  void countSkippedWrite() { ++numSkippedWrites; }
+  void countProgrammed(const std::size_t numLines) { numProgrammedLines += static_cast<uint32_t>(numLines); }
+  void countCopied(const std::size_t numLines) { numCopiedLines += static_cast<uint32_t>(numLines); }
+  void countCompaction() { ++numCompactions; }
+  void countErase(const std::size_t pageIndex) {
+    ++numErases;
+    ++numErasesPerPage[pageIndex];
+  }
+  void countScanned(const std::size_t numLines) const { numScannedLines += static_cast<uint32_t>(numLines); }
+};
+
+/*
+ * Trace hooks for FlashFairyPP.
+ *
+ * A trace type has static member functions that a store calls around its flash operations:
+ *
+ *   onErase(pagePtr)                        - before a page is erased.
+ *   onProgram(linePtr, numLines)            - before numLines consecutive lines are programmed at linePtr.
+ *   onCompactionBegin(pagePtr)              - compaction of the oldest page starts.
+ *   onCompactionEnd(pagePtr)                - all live entries of the oldest page were copied.
+ */
+
+/**
+ * \brief No tracing. The empty hooks are inlined, so tracing compiles out entirely.
+ */
+struct NoTrace {
+  static void onErase(const void*) {}
+  static void onProgram(const void*, const std::size_t) {}
+  static void onCompactionBegin(const void*) {}
+  static void onCompactionEnd(const void*) {}
+};
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__STATISTICS_H__
@@ -0,0 +1,126 @@
+#ifndef __FLASHFAIRYPP__WRITEBACKBUFFER_H__
+#define __FLASHFAIRYPP__WRITEBACKBUFFER_H__
+
+#include <cstddef>
+
+namespace FlashFairyPP {
+
+/**
+ * \brief Write-back cache in front of a FlashFairyPP for values that change frequently, e.g., runtime counters.
+ *
+ * setValue() only updates a RAM table of up to Capacity dirty keys, repeated updates of a key replace its buffered
+ * value. The dirty keys are committed to flash as a single batch, see BasicFlashFairyPP::setValues(), on flush(),
+ * once flushThreshold keys are dirty, or on onBrownOut(). Reads see buffered values before those in flash.
+ *
+ * Buffered values are lost on a reset, so flush() before a controlled shutdown and call onBrownOut() from the
+ * brown-out or power-fail handler while there is still enough energy to program Capacity + 2 lines. Keys that are
+ * written through the buffer should not be written to the store directly, or the buffered value replaces them on the
+ * next flush.
+ */
+template <class FlashFairyT, std::size_t Capacity>
+class WriteBackBuffer {
+ public:
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  constexpr static const std::size_t kCapacity = Capacity;
+
+  explicit WriteBackBuffer(FlashFairyT& flashFairy, const std::size_t flushThreshold = Capacity)
+      : flashFairy_(flashFairy), flushThreshold_(flushThreshold) {}
+
+  /**
+   * \brief Buffer a new value for key. Flushes the buffer first if it is full and after the update if the number of
+   * dirty keys reached the flush threshold.
+   *
+   * \return false if the key is out of range or a flush failed. The value is not buffered if the buffer stays full.
+   */
+  bool setValue(const key_type key, const value_type value) {
+    if (key >= FlashFairyT::kNumKeys) {
+      return false;
+    }
+    if (!dirty_.contains(key) && dirty_.size() == Capacity && !flush()) {
+      return false;
+    }
+    dirty_.setValue(key, value);
+    return (dirty_.size() >= flushThreshold_) ? flush() : true;
+  }
+
+  /**
+   * \brief Read the buffered value of key or, if it is not dirty, the value stored in flash.
+   *
+   * \return Whether a value for key was found. value is only modified if it was.
+   */
+  bool findValue(const key_type key, value_type& value) const {
+    for (const auto& entry : dirty_) {
+      if (entry.first == key) {
+        value = entry.second;
+        return true;
+      }
+    }
+    return flashFairy_.findValue(key, value);
+  }
+
+  /**
+   * \return The buffered or stored value or npos, if the key was never written.
+   */
+  value_type getValue(const key_type key) const {
+    value_type result = FlashFairyT::npos;
+    findValue(key, result);
+    return result;
+  }
+
+  template <typename V>
+  bool readValueIfAvailable(const key_type key, V& value) const {
+    value_type tmpValue;
+    const bool valueAvailable = findValue(key, tmpValue);
+    if (valueAvailable) {
+      value = static_cast<V>(tmpValue);
+    }
+    return valueAvailable;
+  }
+
+  /**
+   * \brief Commit all dirty keys to flash as a single batch. Keys whose buffered value equals the stored one are
+   * not written.
+   *
+   * \return Whether the buffer is clean. On failure, the dirty keys are kept.
+   */
+  bool flush() {
+    if (dirty_.empty()) {
+      return true;
+    }
+    if (!flashFairy_.setValues(dirty_)) {
+      return false;
+    }
+    dirty_.clear();
+    return true;
+  }
+
+  /**
+   * \brief Flush, to be called when supply voltage drops.
+   */
+  void onBrownOut() { flush(); }
+
+  /**
+   * \brief onBrownOut() for C callback registrations, context is the WriteBackBuffer.
+   */
+  static void brownOutCallback(void* context) { static_cast<WriteBackBuffer*>(context)->onBrownOut(); }
+
+  std::size_t numDirty() const { return dirty_.size(); }
+  bool isDirty() const { return !dirty_.empty(); }
+
+  std::size_t getFlushThreshold() const { return flushThreshold_; }
+  void setFlushThreshold(const std::size_t flushThreshold) { flushThreshold_ = flushThreshold; }
+
+ private:
+  FlashFairyT& flashFairy_;
+  std::size_t flushThreshold_;
+  typename FlashFairyT::template WriteBatch<Capacity> dirty_;
+};
+
+template <class FlashFairyT, std::size_t Capacity>
+constexpr const std::size_t WriteBackBuffer<FlashFairyT, Capacity>::kCapacity;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHFAIRYPP__WRITEBACKBUFFER_H__
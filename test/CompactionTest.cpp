@@ -0,0 +1,198 @@
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+template <std::size_t NumPages>
+struct IncrementalTraits : public Traits<> {
+  constexpr static const std::size_t kNumPages = NumPages;
+  constexpr static const std::size_t kCompactionStepEntries = 2;
+};
+
+template <class FlashFairyT>
+class CompactionFixture : public BasicVirtualFlashFixture<FlashFairyT> {
+ public:
+  constexpr static const std::size_t kNumColdKeys = 40;
+  constexpr static const typename FlashFairyT::key_type kHotKey = 200;
+
+  void SetUp() override {
+    BasicVirtualFlashFixture<FlashFairyT>::SetUp();
+    for (std::size_t key = 0; key < kNumColdKeys; ++key) {
+      ASSERT_TRUE(this->flashFairy.setValue(static_cast<typename FlashFairyT::key_type>(key), key + 1000));
+    }
+  }
+
+  /// Write the hot key until a compaction starts.
+  std::size_t writeUntilCompaction() {
+    std::size_t numWrites = 0;
+    while (!this->flashFairy.isCompactionPending()) {
+      EXPECT_TRUE(this->flashFairy.setValue(kHotKey, numWrites++));
+    }
+    return numWrites;
+  }
+
+  void expectColdKeys(const FlashFairyT& flashFairy) {
+    for (std::size_t key = 0; key < kNumColdKeys; ++key) {
+      EXPECT_EQ(flashFairy.getValue(static_cast<typename FlashFairyT::key_type>(key)), key + 1000) << "key: " << key;
+    }
+  }
+};
+
+using CompactionTypes =
+    ::testing::Types<BasicFlashFairyPP<IncrementalTraits<2>>, BasicFlashFairyPP<IncrementalTraits<3>>>;
+TYPED_TEST_SUITE(CompactionFixture, CompactionTypes);
+
+TYPED_TEST(CompactionFixture, SetValueDoesNotErase) {
+  std::size_t numWrites = this->writeUntilCompaction();
+  EXPECT_TRUE(eraseCounts.empty());
+
+  // Every write copies at most kCompactionStepEntries entries and reads stay correct meanwhile.
+  while (this->flashFairy.isCompactionPending()) {
+    const std::size_t entriesLeft = this->flashFairy.numEntriesLeftOnActivePage();
+    ASSERT_TRUE(this->flashFairy.setValue(this->kHotKey, numWrites++));
+    EXPECT_LE(entriesLeft - this->flashFairy.numEntriesLeftOnActivePage(), 1 + TypeParam::kCompactionStepEntries);
+    EXPECT_TRUE(eraseCounts.empty());
+    this->expectColdKeys(this->flashFairy);
+    EXPECT_EQ(this->flashFairy.getValue(this->kHotKey), numWrites - 1);
+
+    // Only poll() erases, once all entries are copied.
+    if (this->flashFairy.poll()) {
+      EXPECT_TRUE(eraseCounts.empty());
+    }
+  }
+  EXPECT_EQ(eraseCounts.size(), 1);
+  this->pageIsEmpty(this->pages[0]);
+  this->expectColdKeys(this->flashFairy);
+}
+
+TYPED_TEST(CompactionFixture, PollOnly) {
+  this->writeUntilCompaction();
+  std::size_t numPolls = 1;
+  while (this->flashFairy.poll()) {
+    ++numPolls;
+  }
+  // The cold keys are copied in steps, followed by a single erase.
+  EXPECT_GE(numPolls, this->kNumColdKeys / TypeParam::kCompactionStepEntries + 1);
+  EXPECT_EQ(eraseCounts.size(), 1);
+  this->expectColdKeys(this->flashFairy);
+}
+
+TYPED_TEST(CompactionFixture, WithoutPoll) {
+  // Writes alone keep the ring going, finishing compactions on demand.
+  for (std::size_t i = 0; i < 8 * TypeParam::kNumPages * 256; ++i) {
+    ASSERT_TRUE(this->flashFairy.setValue(this->kHotKey, i));
+  }
+  this->expectColdKeys(this->flashFairy);
+
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  this->expectColdKeys(flashFairy2);
+  EXPECT_EQ(flashFairy2.getValue(this->kHotKey), 8 * TypeParam::kNumPages * 256 - 1);
+  EXPECT_EQ(flashFairy2.isCompactionPending(), this->flashFairy.isCompactionPending());
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), this->flashFairy.numEntriesLeftOnActivePage());
+}
+
+TYPED_TEST(CompactionFixture, Reset_Resume) {
+  // Several rounds, so that the head is not the last page of the ring.
+  for (std::size_t round = 0; round < TypeParam::kNumPages + 1; ++round) {
+    this->writeUntilCompaction();
+    while (this->flashFairy.poll()) {
+    }
+  }
+  std::size_t numWrites = this->writeUntilCompaction();
+  ASSERT_TRUE(this->flashFairy.setValue(this->kHotKey, numWrites++));
+  ASSERT_TRUE(this->flashFairy.isCompactionPending());
+
+  // Reference: the number of lines that finishing the compaction takes without a reset.
+  uint8_t snapshot[sizeof(this->pages)];
+  memcpy(snapshot, this->pages, sizeof(snapshot));
+  const std::size_t referenceEntriesLeft = this->flashFairy.numEntriesLeftOnActivePage();
+  while (this->flashFairy.poll()) {
+  }
+  const std::size_t referenceCopiedLines = referenceEntriesLeft - this->flashFairy.numEntriesLeftOnActivePage();
+  memcpy(this->pages, snapshot, sizeof(snapshot));
+
+  // A reset during the compaction resumes it.
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  EXPECT_TRUE(flashFairy2.isCompactionPending());
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), referenceEntriesLeft);
+  this->expectColdKeys(flashFairy2);
+  EXPECT_EQ(flashFairy2.getValue(this->kHotKey), numWrites - 1);
+
+  const std::size_t entriesLeft = flashFairy2.numEntriesLeftOnActivePage();
+  while (flashFairy2.poll()) {
+  }
+  // Entries that were copied before the reset were not copied again.
+  EXPECT_EQ(entriesLeft - flashFairy2.numEntriesLeftOnActivePage(), referenceCopiedLines);
+  this->expectColdKeys(flashFairy2);
+
+  TypeParam flashFairy3;
+  flashFairy3.initialize(this->config);
+  EXPECT_FALSE(flashFairy3.isCompactionPending());
+  this->expectColdKeys(flashFairy3);
+  EXPECT_EQ(flashFairy3.getValue(this->kHotKey), numWrites - 1);
+}
+
+TYPED_TEST(CompactionFixture, Overwrite_NotCopiedAgain) {
+  this->writeUntilCompaction();
+
+  // Entries of the tail page that are overwritten before they are copied stay stale.
+  for (std::size_t key = 0; key < this->kNumColdKeys; ++key) {
+    ASSERT_TRUE(this->flashFairy.setValue(static_cast<typename TypeParam::key_type>(key), key + 2000));
+  }
+  while (this->flashFairy.poll()) {
+  }
+  for (std::size_t key = 0; key < this->kNumColdKeys; ++key) {
+    EXPECT_EQ(this->flashFairy.getValue(static_cast<typename TypeParam::key_type>(key)), key + 2000);
+  }
+
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  for (std::size_t key = 0; key < this->kNumColdKeys; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(static_cast<typename TypeParam::key_type>(key)), key + 2000);
+  }
+}
+
+struct CountingIncrementalTraits : public IncrementalTraits<2> {
+  constexpr static const std::size_t kCompactionStepEntries = 1;
+  template <std::size_t NumPages>
+  using Statistics = ::FlashFairyPP::Statistics<NumPages>;
+};
+
+using CountingCompactionFixture = CompactionFixture<BasicFlashFairyPP<CountingIncrementalTraits>>;
+
+TEST_F(CountingCompactionFixture, StepReadsOnlyCopiedLines) {
+  writeUntilCompaction();
+  const auto& statistics = flashFairy.getStatistics();
+  std::size_t numPolls = 0;
+  while (flashFairy.isCompactionPending()) {
+    const uint32_t scannedLines = statistics.numScannedLines;
+    flashFairy.poll();
+    EXPECT_EQ(statistics.numScannedLines, scannedLines);
+    ++numPolls;
+  }
+  // One step per cold key plus the erase.
+  EXPECT_EQ(numPolls, kNumColdKeys + 1);
+  expectColdKeys(flashFairy);
+}
+
+TYPED_TEST(CompactionFixture, Batch_ReservesCompactionLines) {
+  this->writeUntilCompaction();
+
+  // A batch never takes the lines that the pending compaction still needs.
+  typename TypeParam::template WriteBatch<8> batch;
+  for (std::size_t i = 0; i < 40; ++i) {
+    for (typename TypeParam::key_type key = 0; key < 8; ++key) {
+      batch.setValue(static_cast<typename TypeParam::key_type>(100 + key), static_cast<uint16_t>(i * 8 + key));
+    }
+    ASSERT_TRUE(this->flashFairy.setValues(batch));
+    this->expectColdKeys(this->flashFairy);
+  }
+  for (typename TypeParam::key_type key = 0; key < 8; ++key) {
+    EXPECT_EQ(this->flashFairy.getValue(static_cast<typename TypeParam::key_type>(100 + key)), 39 * 8 + key);
+  }
+}
+
+}  // namespace FlashFairyPP
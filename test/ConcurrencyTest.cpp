@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+struct ConcurrentTraits : public Traits<1024, 64> {
+  using ReadSync = SeqLockReadSync;
+};
+using ConcurrentFlashFairy = BasicFlashFairyPP<ConcurrentTraits>;
+
+struct ConcurrentRingTraits : public ConcurrentTraits {
+  constexpr static const std::size_t kNumPages = 4;
+  constexpr static const std::size_t kCompactionStepEntries = 2;
+};
+using ConcurrentRing = BasicFlashFairyPP<ConcurrentRingTraits>;
+
+static_assert(ConcurrentFlashFairy::kConcurrentReads, "SeqLockReadSync enables concurrent reads");
+static_assert(!FlashFairyPP::kConcurrentReads, "Reads are not synchronized by default");
+
+/// Forwards to the C hooks and calls interrupt around flash operations, like an ISR would.
+struct InterruptingFlashHal {
+  static std::function<void()> interrupt;
+
+  static void unlock() {}
+  static void lock() {}
+  static void erasePage(void* pagePtr) {
+    interrupt();
+    FlashFairy_Erase_Page(pagePtr);
+    interrupt();
+  }
+  static void programLine(void* linePtr, const uint32_t line) {
+    interrupt();
+    FlashFairy_Write_Word(linePtr, line);
+  }
+};
+
+std::function<void()> InterruptingFlashHal::interrupt = [] {};
+
+struct InterruptedTraits : public ConcurrentTraits {
+  using FlashHal = InterruptingFlashHal;
+};
+using InterruptedFlashFairy = BasicFlashFairyPP<InterruptedTraits>;
+
+constexpr const std::size_t kNumStressKeys = 16;
+
+std::size_t numErases() {
+  std::size_t result = 0;
+  for (const auto& eraseCount : eraseCounts) {
+    result += eraseCount.second;
+  }
+  return result;
+}
+
+template <class FlashFairyT>
+class ConcurrencyFixture : public BasicVirtualFlashFixture<FlashFairyT> {
+ public:
+  using value_type = typename FlashFairyT::value_type;
+
+  void TearDown() override { InterruptingFlashHal::interrupt = [] {}; }
+
+  /**
+   * \brief Write rounds of increasing values to kNumStressKeys keys while readers check every value they see.
+   *
+   * Each key holds a value before the readers start, so a reader must never miss a key, and values of a key never
+   * decrease.
+   */
+  void stress(const std::size_t numRounds, const std::size_t numReaders) {
+    FlashFairyT& flashFairy = this->flashFairy;
+    for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+      ASSERT_TRUE(flashFairy.setValue(key, 0));
+    }
+
+    std::atomic<bool> done(false);
+    std::atomic<std::size_t> numReads(0);
+    std::atomic<std::size_t> numMissing(0);
+    std::atomic<std::size_t> numDecreasing(0);
+    std::vector<std::thread> readers;
+    for (std::size_t reader = 0; reader < numReaders; ++reader) {
+      readers.emplace_back([&flashFairy, &done, &numReads, &numMissing, &numDecreasing, reader] {
+        value_type lastValues[kNumStressKeys] = {};
+        std::size_t reads = 0;
+        while (!done.load()) {
+          if (reader % 2 == 0) {
+            for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+              const value_type value = flashFairy.getValue(key);
+              if (value == FlashFairyT::npos) {
+                ++numMissing;
+              } else if (value < lastValues[key]) {
+                ++numDecreasing;
+              } else {
+                lastValues[key] = value;
+              }
+            }
+          } else {
+            value_type values[FlashFairyT::kNumKeys];
+            typename FlashFairyT::KeyBitmap_t present;
+            if (flashFairy.loadValues(values, present) != kNumStressKeys ||
+                flashFairy.countLiveKeys() != kNumStressKeys) {
+              ++numMissing;
+            }
+          }
+          ++reads;
+        }
+        numReads += reads;
+      });
+    }
+
+    for (std::size_t round = 1; round <= numRounds; ++round) {
+      for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+        ASSERT_TRUE(flashFairy.setValue(key, static_cast<value_type>(round)));
+      }
+      flashFairy.poll();
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+      reader.join();
+    }
+
+    EXPECT_GT(numReads.load(), 0u);
+    EXPECT_EQ(numMissing.load(), 0u);
+    EXPECT_EQ(numDecreasing.load(), 0u);
+    for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+      EXPECT_EQ(flashFairy.getValue(key), numRounds);
+    }
+    // Many page switches, each of which erased a page while the readers were running.
+    EXPECT_GT(numErases(), 100u);
+  }
+};
+
+using ConcurrencyTest = ConcurrencyFixture<ConcurrentFlashFairy>;
+using ConcurrencyRingTest = ConcurrencyFixture<ConcurrentRing>;
+using InterruptedTest = ConcurrencyFixture<InterruptedFlashFairy>;
+
+TEST_F(ConcurrencyTest, ReadersDuringCompaction) { stress(3000, 4); }
+
+TEST_F(ConcurrencyRingTest, ReadersDuringIncrementalCompaction) { stress(3000, 4); }
+
+TEST_F(ConcurrencyTest, FormatFlash) {
+  ASSERT_TRUE(flashFairy.setValue(1, 10));
+  std::atomic<bool> done(false);
+  std::atomic<std::size_t> numInvalid(0);
+  std::thread reader([this, &done, &numInvalid] {
+    while (!done.load()) {
+      const auto value = flashFairy.getValue(1);
+      if (value != 10 && value != 11 && value != ConcurrentFlashFairy::npos) {
+        ++numInvalid;
+      }
+    }
+  });
+  for (std::size_t i = 0; i < 200; ++i) {
+    flashFairy.formatFlash();
+    flashFairy.setValue(1, 11);
+  }
+  done = true;
+  reader.join();
+  EXPECT_EQ(numInvalid.load(), 0u);
+  EXPECT_EQ(flashFairy.getValue(1), 11);
+}
+
+TEST_F(InterruptedTest, ReadsCompletedWrites) {
+  // Values of the last completed write, and of the write in progress.
+  value_type committed[kNumStressKeys];
+  value_type pending[kNumStressKeys];
+  std::fill(committed, committed + kNumStressKeys, ConcurrentFlashFairy::npos);
+  std::fill(pending, pending + kNumStressKeys, ConcurrentFlashFairy::npos);
+  std::size_t numInterrupts = 0;
+  InterruptingFlashHal::interrupt = [&] {
+    ++numInterrupts;
+    for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+      const value_type value = flashFairy.getValue(key);
+      EXPECT_TRUE(value == committed[key] || value == pending[key]) << "Key " << key << ", value " << value;
+    }
+  };
+
+  for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+    pending[key] = static_cast<value_type>(key);
+    ASSERT_TRUE(flashFairy.setValue(key, pending[key]));
+    committed[key] = pending[key];
+  }
+  for (std::size_t round = 1; round < 100; ++round) {
+    for (std::size_t key = 0; key < kNumStressKeys; ++key) {
+      pending[key] = static_cast<value_type>(round * kNumStressKeys + key);
+      ASSERT_TRUE(flashFairy.setValue(key, pending[key]));
+      committed[key] = pending[key];
+    }
+  }
+  EXPECT_GT(numInterrupts, 1000u);
+  EXPECT_GT(numErases(), 5u);
+}
+
+}  // namespace FlashFairyPP
@@ -1,9 +1,18 @@
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <vector>
+
 #include "Mocks.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace FlashFairyPP {
 
+/// Lines of a page that hold data and their offset in bytes, behind the page header.
+constexpr static const std::size_t kDataLines = 256 - FlashFairyPP::kPageHeaderLines;
+constexpr static const std::size_t kDataOffset = FlashFairyPP::kPageHeaderLines * 4;
+
 TEST_F(VirtualFlashFixture, Format) {
   EXPECT_THAT(*pages, ::testing::Each(0xFF));
   memset(pages, 0x00, sizeof(pages));
@@ -14,14 +23,14 @@ TEST_F(VirtualFlashFixture, Format) {
 
 TEST_F(VirtualFlashFixture, Read_Empty) {
   EXPECT_EQ(flashFairy.getValue(42), 0xCAFE);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 256);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines);
 }
 
 TEST_F(VirtualFlashFixture, ReadConditional_Empty) {
   FlashFairyPP::value_type value = 1234;
   EXPECT_FALSE(flashFairy.readValueIfAvailable(42, value));
   EXPECT_EQ(value, 1234);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 256);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines);
 }
 
 TEST_F(VirtualFlashFixture, TypedReadConditional_Empty) {
@@ -30,7 +39,7 @@ TEST_F(VirtualFlashFixture, TypedReadConditional_Empty) {
   Values value = Values::ONE;
   EXPECT_FALSE(flashFairy.readValueIfAvailable(42, value));
   EXPECT_EQ(value, Values::ONE);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 256);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines);
 }
 
 TEST_F(VirtualFlashFixture, ReadConditional_Value) {
@@ -38,7 +47,7 @@ TEST_F(VirtualFlashFixture, ReadConditional_Value) {
   FlashFairyPP::value_type value = 27;
   EXPECT_TRUE(flashFairy.readValueIfAvailable(42, value));
   EXPECT_EQ(value, 1234);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 255);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
 }
 
 TEST_F(VirtualFlashFixture, TypedReadConditional_Value) {
@@ -48,15 +57,35 @@ TEST_F(VirtualFlashFixture, TypedReadConditional_Value) {
   Values value = Values::ZERO;
   EXPECT_TRUE(flashFairy.readValueIfAvailable(42, value));
   EXPECT_EQ(value, Values::ONE);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 255);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
 }
 
 TEST_F(VirtualFlashFixture, Write_Twice) {
   EXPECT_TRUE(flashFairy.setValue(42, 0xBEEF));
   EXPECT_TRUE(flashFairy.setValue(42, 0xBEEF));
   EXPECT_EQ(flashFairy.getValue(42), 0xBEEF);
-  memoryIsEmpty((pages[0]) + 4, FlashFairyPP::Config_t::pageSize - 4);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 255);
+  memoryIsEmpty((pages[0]) + kDataOffset + 4, FlashFairyPP::Config_t::pageSize - kDataOffset - 4);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
+}
+
+TEST_F(VirtualFlashFixture, Write_Npos) {
+  // npos is a valid value and must be stored, not mistaken for the value of a missing key.
+  EXPECT_TRUE(flashFairy.setValue(42, FlashFairyPP::npos));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
+  FlashFairyPP::value_type value = 27;
+  EXPECT_TRUE(flashFairy.readValueIfAvailable(42, value));
+  EXPECT_EQ(value, FlashFairyPP::npos);
+}
+
+TEST_F(VirtualFlashFixture, NewestFirst) {
+  // Many versions of the same key: the newest one is returned.
+  for (FlashFairyPP::value_type i = 0; i < 200; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(static_cast<FlashFairyPP::key_type>(i % 3), i));
+  }
+  EXPECT_EQ(flashFairy.getValue(0), 198);
+  EXPECT_EQ(flashFairy.getValue(1), 199);
+  EXPECT_EQ(flashFairy.getValue(2), 197);
+  EXPECT_EQ(flashFairy.getValue(3), FlashFairyPP::npos);
 }
 
 TEST_F(VirtualFlashFixture, Write_OutOfBounds) {
@@ -73,19 +102,19 @@ TEST_F(VirtualFlashFixture, Store_Load_Store_SingleValue) {
   EXPECT_EQ(flashFairy.getValue(42), 0xBEEF);
   EXPECT_TRUE(flashFairy.setValue(42, 0xAFFE));
   EXPECT_EQ(flashFairy.getValue(42), 0xAFFE);
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 256 - 2);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2);
 
   // At least on x86_64, the uint32s are stored in LSB.
-  EXPECT_EQ(pages[0][0], 0xEF);
-  EXPECT_EQ(pages[0][1], 0xBE);
-  EXPECT_EQ(pages[0][2], 0x2A);
-  EXPECT_EQ(pages[0][3], 0x00);
-  EXPECT_EQ(pages[0][4], 0xFE);
-  EXPECT_EQ(pages[0][5], 0xAF);
-  EXPECT_EQ(pages[0][6], 0x2A);
-  EXPECT_EQ(pages[0][7], 0x00);
-  EXPECT_EQ(pages[0][8], 0xFF);
-  memoryIsEmpty((pages[0]) + 8, FlashFairyPP::Config_t::pageSize - 8);
+  EXPECT_EQ(pages[0][kDataOffset + 0], 0xEF);
+  EXPECT_EQ(pages[0][kDataOffset + 1], 0xBE);
+  EXPECT_EQ(pages[0][kDataOffset + 2], 0x2A);
+  EXPECT_EQ(pages[0][kDataOffset + 3], 0x00);
+  EXPECT_EQ(pages[0][kDataOffset + 4], 0xFE);
+  EXPECT_EQ(pages[0][kDataOffset + 5], 0xAF);
+  EXPECT_EQ(pages[0][kDataOffset + 6], 0x2A);
+  EXPECT_EQ(pages[0][kDataOffset + 7], 0x00);
+  EXPECT_EQ(pages[0][kDataOffset + 8], 0xFF);
+  memoryIsEmpty((pages[0]) + kDataOffset + 8, FlashFairyPP::Config_t::pageSize - kDataOffset - 8);
 
   pageIsEmpty(pages[1]);
 }
@@ -107,7 +136,7 @@ TEST_F(VirtualFlashFixture, MultipleValues) {
   EXPECT_EQ(flashFairy.getValue(254), 0xDEAF);
 
   // Stored four values -> 16 bytes. Remainder should be empty.
-  memoryIsEmpty(pages[0] + 16, FlashFairyPP::Config_t::pageSize - 16);
+  memoryIsEmpty(pages[0] + kDataOffset + 16, FlashFairyPP::Config_t::pageSize - kDataOffset - 16);
 
   pageIsEmpty(pages[1]);
 }
@@ -139,34 +168,56 @@ TEST_F(VirtualFlashFixture, Write_Reset_Load) {
   EXPECT_EQ(flashFairy2.getValue(2), 0xCAFE);
 
   EXPECT_EQ(flashFairy2.getValue(255), 0xDEAF);
-  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), 256 - 4);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 4);
 }
 
-TEST_F(VirtualFlashFixture, WriteSecondPage) {
-  // Write a single value so often that the memory gets full
+TEST_F(VirtualFlashFixture, WriteCursor_Reset_Load) {
+  // Fill all but the last line of the page with distinct values.
+  for (std::size_t i = 0; i < kDataLines - 1; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % 100, i));
+    EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1 - i);
+  }
 
-  std::size_t numFlashLines = FlashFairyPP::Config_t::pageSize / sizeof(FlashFairyPP::FlashLine_t);
+  // A new instance has to find the free line without help.
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), 1);
+
+  // The last line is appended at the end of the page and not anywhere else.
+  EXPECT_TRUE(flashFairy2.setValue(7, 0xBEEF));
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), 0);
+  EXPECT_EQ(pages[0][1020], 0xEF);
+  EXPECT_EQ(pages[0][1021], 0xBE);
+  EXPECT_EQ(pages[0][1022], 0x07);
+  EXPECT_EQ(pages[0][1023], 0x00);
+  EXPECT_EQ(flashFairy2.getValue(7), 0xBEEF);
+  pageIsEmpty(pages[1]);
+}
 
-  for (std::size_t i = 0; i < numFlashLines; ++i) {
-    EXPECT_TRUE(flashFairy.setValue(i % (FlashFairyPP::kNumKeys / 2), i));
+TEST_F(VirtualFlashFixture, WriteSecondPage) {
+  // Write half of the keys so often that the memory gets full
+  constexpr static const std::size_t kNumHalfKeys = FlashFairyPP::kNumKeys / 2;
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    EXPECT_TRUE(flashFairy.setValue(i % kNumHalfKeys, i));
   }
+  auto firstFill = [](std::size_t key) { return (key + kNumHalfKeys < kDataLines) ? key + kNumHalfKeys : key; };
 
   // pages[0] is now full, pages[1] is still untouched
   pageIsEmpty(pages[1]);
 
-  for (std::size_t i = 0; i < 128; ++i) {
-    EXPECT_EQ(flashFairy.getValue(i), i + 128);
+  for (std::size_t i = 0; i < kNumHalfKeys; ++i) {
+    EXPECT_EQ(flashFairy.getValue(i), firstFill(i));
   }
   EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 0);
 
   // Write another value, will cause an overflow to the second page.
   EXPECT_TRUE(flashFairy.setValue(25, 0x3456));
 
-  for (std::size_t i = 0; i < 128; ++i) {
+  for (std::size_t i = 0; i < kNumHalfKeys; ++i) {
     if (i == 25) {
       EXPECT_EQ(flashFairy.getValue(i), 0x3456) << "i: " << i;
     } else {
-      EXPECT_EQ(flashFairy.getValue(i), i + 128) << "i: " << i;
+      EXPECT_EQ(flashFairy.getValue(i), firstFill(i)) << "i: " << i;
     }
   }
 
@@ -174,11 +225,12 @@ TEST_F(VirtualFlashFixture, WriteSecondPage) {
   pageIsEmpty(pages[0]);
 
   // Since we wrote to only half the keys, the second page should be half-filled.
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 128);
-  memoryIsEmpty(pages[1] + (128 * 4), 1024 - (128 * 4));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - kNumHalfKeys);
+  memoryIsEmpty(pages[1] + kDataOffset + (kNumHalfKeys * 4), 1024 - kDataOffset - (kNumHalfKeys * 4));
 
-  // Go on to fill the second page (127 entries left)
-  for (std::size_t i = 0; i < 128; ++i) {
+  // Go on to fill the second page
+  const std::size_t numSecondFill = flashFairy.numEntriesLeftOnActivePage();
+  for (std::size_t i = 0; i < numSecondFill; ++i) {
     EXPECT_TRUE(flashFairy.setValue(i, i));
   }
   EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 0);
@@ -190,14 +242,16 @@ TEST_F(VirtualFlashFixture, WriteSecondPage) {
   pageIsEmpty(pages[1]);
 
   // Since we wrote to only half the keys, the first page should be half-filled.
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 128);
-  memoryIsEmpty(pages[0] + (128 * 4), 1024 - (128 * 4));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - kNumHalfKeys);
+  memoryIsEmpty(pages[0] + kDataOffset + (kNumHalfKeys * 4), 1024 - kDataOffset - (kNumHalfKeys * 4));
 
-  for (std::size_t i = 0; i < 128; ++i) {
+  for (std::size_t i = 0; i < kNumHalfKeys; ++i) {
     if (i == 25) {
       EXPECT_EQ(flashFairy.getValue(i), 0xD017) << "i: " << i;
-    } else {
+    } else if (i < numSecondFill) {
       EXPECT_EQ(flashFairy.getValue(i), i) << "i: " << i;
+    } else {
+      EXPECT_EQ(flashFairy.getValue(i), firstFill(i)) << "i: " << i;
     }
   }
 }
@@ -207,7 +261,8 @@ TEST_F(VirtualFlashFixture, BothPagesFull) {
   memset(pages, 0x00, sizeof(pages));
   EXPECT_THAT(*pages, ::testing::Each(0x00));
 
-  // (Re)initialize the flashFairy where neither page is empty.
+  // (Re)initialize the flashFairy where neither page is empty. Neither page has a header, so the second page holds
+  // values of the format before page headers.
   flashFairy.initialize(config);
 
   // Expect to be able to read value 0 but nothing else
@@ -237,41 +292,222 @@ TEST_F(VirtualFlashFixture, BothPagesFull) {
   EXPECT_THAT(pages[1], ::testing::Each(0xFF));
 }
 
-TEST_F(VirtualFlashFixture, WriteSecondPage_Reset_Load) {
-  // Write a single value so often that the memory gets full
+TEST_F(VirtualFlashFixture, LegacyPage_Migrated) {
+  // A first page in the format before page headers: values from the first line on, the last one of a key is newest.
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]);
+  lines[0] = 0x0001BEEF;
+  lines[1] = 0x002A1234;
+  lines[2] = 0x00010042;
+  lines[3] = 0x00FFAFFE;
+
+  EXPECT_TRUE(flashFairy.initialize(config));
+  EXPECT_EQ(flashFairy.getValue(1), 0x0042);
+  EXPECT_EQ(flashFairy.getValue(42), 0x1234);
+  EXPECT_EQ(flashFairy.getValue(255), 0xAFFE);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 3);
+  EXPECT_EQ(eraseCounts.size(), 1u);
+  pageIsEmpty(pages[0]);
+
+  // The migrated page is a regular page of the ring.
+  uint32_t* migratedLines = reinterpret_cast<uint32_t*>(pages[1]);
+  EXPECT_EQ(migratedLines[0], 0xFFFA0000);
+  EXPECT_EQ(migratedLines[1], 0xFFF90000);
+  EXPECT_TRUE(flashFairy.setValue(1, 0x0043));
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(1), 0x0043);
+  EXPECT_EQ(flashFairy2.getValue(42), 0x1234);
+  EXPECT_EQ(flashFairy2.getValue(255), 0xAFFE);
+  EXPECT_EQ(eraseCounts.size(), 1u);
+}
 
-  std::size_t numFlashLines = FlashFairyPP::Config_t::pageSize / sizeof(FlashFairyPP::FlashLine_t);
+TEST_F(VirtualFlashFixture, LegacyPage_InterruptedMigration) {
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[1]);
+  lines[0] = 0x0001BEEF;
+  lines[1] = 0x002A1234;
+
+  // A power loss after the first copied value, before the migrated page was activated.
+  uint32_t* migratedLines = reinterpret_cast<uint32_t*>(pages[0]);
+  migratedLines[0] = 0xFFFA0000;
+  migratedLines[FlashFairyPP::kPageHeaderLines] = 0x002A1234;
+
+  flashFairy.initialize(config);
+  EXPECT_EQ(flashFairy.getValue(1), 0xBEEF);
+  EXPECT_EQ(flashFairy.getValue(42), 0x1234);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2);
+  pageIsEmpty(pages[1]);
+}
 
-  for (std::size_t i = 0; i < numFlashLines; ++i) {
-    EXPECT_TRUE(flashFairy.setValue(i % (FlashFairyPP::kNumKeys / 2), i));
+TEST_F(VirtualFlashFixture, LegacyPage_TooManyKeys) {
+  // A value of every key does not fit on a page with a header. Migration is refused instead of dropping values.
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[1]);
+  for (uint32_t key = 0; key < FlashFairyPP::kNumKeys; ++key) {
+    lines[key] = key << 16 | key;
   }
+  uint8_t legacyPages[sizeof(pages)];
+  memcpy(legacyPages, pages, sizeof(pages));
+
+  EXPECT_FALSE(flashFairy.initialize(config));
+  EXPECT_EQ(memcmp(pages, legacyPages, sizeof(pages)), 0);
+  EXPECT_TRUE(eraseCounts.empty());
+  EXPECT_EQ(flashFairy.getValue(255), FlashFairyPP::npos);
+
+  // Writes would erase the legacy values.
+  EXPECT_FALSE(flashFairy.setValue(1, 0xBEEF));
+  FlashFairyPP::WriteBatch<1> batch;
+  ASSERT_TRUE(batch.setValue(2, 0xBEEF));
+  EXPECT_FALSE(flashFairy.setValues(batch));
+  EXPECT_FALSE(flashFairy.compactNow());
+  EXPECT_FALSE(flashFairy.poll());
+  EXPECT_EQ(memcmp(pages, legacyPages, sizeof(pages)), 0);
+
+  // Formatting discards them explicitly.
+  EXPECT_TRUE(flashFairy.formatFlash());
+  EXPECT_TRUE(flashFairy.setValue(1, 0xBEEF));
+  EXPECT_EQ(flashFairy.getValue(1), 0xBEEF);
+}
 
-  // pages[0] is now full, pages[1] is still untouched
+TEST_F(VirtualFlashFixture, LegacyPage_KeyOutOfRange) {
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]);
+  lines[0] = 0x0001BEEF;
+  lines[1] = static_cast<uint32_t>(FlashFairyPP::kNumKeys) << 16 | 0xDEAD;
+
+  EXPECT_FALSE(flashFairy.initialize(config));
+  EXPECT_EQ(lines[0], 0x0001BEEF);
+  EXPECT_TRUE(eraseCounts.empty());
   pageIsEmpty(pages[1]);
+}
+
+TEST_F(VirtualFlashFixture, PageHeader_Layout) {
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]);
+
+  // The first page is opened by the first write: begin and active with generation 0.
+  EXPECT_EQ(lines[0], 0xFFFFFFFF);
+  EXPECT_TRUE(flashFairy.setValue(1, 0xBEEF));
+  EXPECT_EQ(lines[0], 0xFFFA0000);
+  EXPECT_EQ(lines[1], 0xFFF90000);
+  EXPECT_EQ(lines[2], 0xFFFFFFFF);
+  EXPECT_EQ(lines[3], 0x0001BEEF);
+
+  // Switching pages closes the old page before it is compacted.
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(2, i));
+  }
+  uint32_t* secondLines = reinterpret_cast<uint32_t*>(pages[1]);
+  EXPECT_EQ(secondLines[0], 0xFFFA0001);
+  EXPECT_EQ(secondLines[1], 0xFFF90001);
+  EXPECT_EQ(secondLines[2], 0xFFFFFFFF);
+  pageIsEmpty(pages[0]);
 
-  for (std::size_t i = 0; i < 128; ++i) {
-    EXPECT_EQ(flashFairy.getValue(i), i + 128);
+  // Generations keep counting up across the ring.
+  for (std::size_t i = 0; lines[0] == 0xFFFFFFFF; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(3, i));
   }
+  EXPECT_EQ(lines[0], 0xFFFA0002);
+}
+
+TEST_F(VirtualFlashFixture, PageHeader_InterruptedCopy) {
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % 20, i));
+  }
+
+  // Power loss right after the next page was opened: it is receiving, the old page was closed.
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]);
+  uint32_t* secondLines = reinterpret_cast<uint32_t*>(pages[1]);
+  lines[2] = 0xFFF80000 | kDataLines;
+  secondLines[0] = 0xFFFA0001;
+
+  // Mounting finishes the page switch.
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  pageIsEmpty(pages[0]);
+  EXPECT_EQ(secondLines[1], 0xFFF90001);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 20);
+  for (std::size_t key = 0; key < 20; ++key) {
+    std::size_t newestWrite = kDataLines - 1;
+    while (newestWrite % 20 != key) {
+      --newestWrite;
+    }
+    EXPECT_EQ(flashFairy2.getValue(key), newestWrite) << "key: " << key;
+  }
+}
+
+TEST_F(VirtualFlashFixture, PageHeader_ClosedHead) {
+  for (std::size_t i = 0; i < kDataLines - 3; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % 20, i));
+  }
+
+  // Power loss right after a batch that did not fit closed the page, before the next page was started.
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]);
+  lines[2] = 0xFFF80000 | (kDataLines - 3);
+
+  // Mounting finishes the page switch, so that later writes are not hidden behind the recorded data lines.
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  pageIsEmpty(pages[0]);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 20);
+  ASSERT_TRUE(flashFairy2.setValue(6, 0xBEEF));
+  for (std::size_t i = 0; i < 2 * kDataLines; ++i) {
+    ASSERT_TRUE(flashFairy2.setValue(30, i));
+  }
+  EXPECT_EQ(flashFairy2.getValue(6), 0xBEEF);
+
+  FlashFairyPP flashFairy3;
+  flashFairy3.initialize(config);
+  EXPECT_EQ(flashFairy3.getValue(6), 0xBEEF);
+}
+
+TEST_F(VirtualFlashFixture, PageHeader_ObsoleteTail) {
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % 20, i));
+  }
+  uint8_t oldPage[sizeof(pages[0])];
+  memcpy(oldPage, pages[0], sizeof(oldPage));
+  ASSERT_TRUE(flashFairy.setValue(30, 0xBEEF));
+
+  // Power loss after the copy, but before the old page was erased.
+  memcpy(pages[0], oldPage, sizeof(oldPage));
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  pageIsEmpty(pages[0]);
+  EXPECT_EQ(flashFairy2.getValue(30), 0xBEEF);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), flashFairy.numEntriesLeftOnActivePage());
+  for (std::size_t key = 0; key < 20; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(key), flashFairy.getValue(key)) << "key: " << key;
+  }
+}
+
+TEST_F(VirtualFlashFixture, WriteSecondPage_Reset_Load) {
+  // Write half of the keys so often that the memory gets full
+  constexpr static const std::size_t kNumHalfKeys = FlashFairyPP::kNumKeys / 2;
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    EXPECT_TRUE(flashFairy.setValue(i % kNumHalfKeys, i));
+  }
+  auto firstFill = [](std::size_t key) { return (key + kNumHalfKeys < kDataLines) ? key + kNumHalfKeys : key; };
+
+  // pages[0] is now full, pages[1] is still untouched
+  pageIsEmpty(pages[1]);
   EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 0);
 
   // Write another value, will cause an overflow to the second page.
   EXPECT_TRUE(flashFairy.setValue(25, 0x3456));
 
   // First page is now empty.
-  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 128);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - kNumHalfKeys);
   pageIsEmpty(pages[0]);
 
   // Now setup a new flashFairy on the result
   FlashFairyPP flashFairy2;
   flashFairy2.initialize(config);
 
-  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), 128);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - kNumHalfKeys);
 
-  for (std::size_t i = 0; i < 128; ++i) {
+  for (std::size_t i = 0; i < kNumHalfKeys; ++i) {
     if (i == 25) {
       EXPECT_EQ(flashFairy2.getValue(i), 0x3456) << "i: " << i;
     } else {
-      EXPECT_EQ(flashFairy2.getValue(i), i + 128) << "i: " << i;
+      EXPECT_EQ(flashFairy2.getValue(i), firstFill(i)) << "i: " << i;
     }
   }
 }
@@ -296,4 +532,252 @@ TEST_F(VirtualFlashFixture, ReadVisitor) {
   flashFairy.visitEntries(v);
 }
 
+TEST_F(VirtualFlashFixture, LiveEntries) {
+  EXPECT_EQ(flashFairy.liveEntries().begin(), flashFairy.liveEntries().end());
+
+  ASSERT_TRUE(flashFairy.setValue(4, 5));
+  ASSERT_TRUE(flashFairy.setValue(6, 7));
+  ASSERT_TRUE(flashFairy.setValue(8, 9));
+  ASSERT_TRUE(flashFairy.setValue(6, 9));
+  ASSERT_TRUE(flashFairy.setValue(10, 11));
+  ASSERT_TRUE(flashFairy.setRecord(10, uint32_t(0xDEADBEEF)));
+
+  std::vector<FlashFairyPP::Entry_t> entries;
+  for (const FlashFairyPP::Entry_t& entry : flashFairy.liveEntries()) {
+    entries.push_back(entry);
+  }
+  EXPECT_THAT(entries, ::testing::ElementsAre(FlashFairyPP::Entry_t(6, 9), FlashFairyPP::Entry_t(8, 9),
+                                              FlashFairyPP::Entry_t(4, 5)));
+
+  // Iterators are independent copies.
+  auto it = flashFairy.liveEntries().begin();
+  auto copy = it++;
+  EXPECT_EQ(copy->first, 6);
+  EXPECT_EQ(it->first, 8);
+  EXPECT_NE(it, copy);
+  EXPECT_EQ(std::distance(it, flashFairy.liveEntries().end()), 2);
+}
+
+TEST_F(VirtualFlashFixture, LiveEntries_SecondPage) {
+  for (FlashFairyPP::key_type key = 0; key < 10; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(20, static_cast<FlashFairyPP::value_type>(i)));
+  }
+
+  std::map<FlashFairyPP::key_type, FlashFairyPP::value_type> entries;
+  for (const auto& entry : flashFairy.liveEntries()) {
+    EXPECT_TRUE(entries.emplace(entry.first, entry.second).second) << entry.first;
+  }
+  EXPECT_EQ(entries.size(), 11);
+  for (const auto& entry : entries) {
+    EXPECT_EQ(entry.second, flashFairy.getValue(entry.first));
+  }
+}
+
+TEST_F(VirtualFlashFixture, LoadValues) {
+  FlashFairyPP::value_type values[FlashFairyPP::kNumKeys];
+  std::fill(std::begin(values), std::end(values), 0x1234);
+  FlashFairyPP::KeyBitmap_t present;
+  EXPECT_EQ(flashFairy.loadValues(values, present), 0);
+
+  ASSERT_TRUE(flashFairy.setValue(4, 5));
+  ASSERT_TRUE(flashFairy.setValue(6, 7));
+  ASSERT_TRUE(flashFairy.setValue(255, 9));
+  ASSERT_TRUE(flashFairy.setValue(6, 8));
+  ASSERT_TRUE(flashFairy.setRecord(10, uint32_t(0xDEADBEEF)));
+  ASSERT_TRUE(flashFairy.setValue(11, 12));
+  ASSERT_TRUE(flashFairy.setRecord(11, uint32_t(0xDEADBEEF)));
+
+  EXPECT_EQ(flashFairy.loadValues(values, present), 3);
+  for (FlashFairyPP::key_type key = 0; key < FlashFairyPP::kNumKeys; ++key) {
+    const bool isLoaded = key == 4 || key == 6 || key == 255;
+    EXPECT_EQ(present.isSet(key), isLoaded) << key;
+    EXPECT_EQ(values[key], isLoaded ? flashFairy.getValue(key) : 0x1234) << key;
+  }
+}
+
+TEST_F(VirtualFlashFixture, LoadValues_SecondPage) {
+  for (FlashFairyPP::key_type key = 0; key < 10; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  for (std::size_t i = 0; i < kDataLines; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(20, static_cast<FlashFairyPP::value_type>(i)));
+  }
+  ASSERT_TRUE(flashFairy.setValue(3, 33));
+
+  FlashFairyPP::value_type values[FlashFairyPP::kNumKeys] = {};
+  FlashFairyPP::KeyBitmap_t present;
+  present.setBit(100);
+  EXPECT_EQ(flashFairy.loadValues(values, present), 11);
+  EXPECT_FALSE(present.isSet(100));
+  for (FlashFairyPP::key_type key = 0; key < 10; ++key) {
+    EXPECT_TRUE(present.isSet(key));
+    EXPECT_EQ(values[key], (key == 3) ? 33 : key);
+  }
+  EXPECT_EQ(values[20], kDataLines - 1);
+}
+
+TEST_F(VirtualFlashFixture, Batch_Write) {
+  FlashFairyPP::WriteBatch<4> batch;
+  EXPECT_TRUE(batch.setValue(1, 0xBEEF));
+  EXPECT_TRUE(batch.setValue(2, 0xDEAD));
+  EXPECT_TRUE(batch.setValue(1, 0xAFFE));
+  EXPECT_FALSE(batch.setValue(FlashFairyPP::kNumKeys, 0));
+  EXPECT_EQ(batch.size(), 2);
+
+  EXPECT_TRUE(flashFairy.setValues(batch));
+  EXPECT_EQ(flashFairy.getValue(1), 0xAFFE);
+  EXPECT_EQ(flashFairy.getValue(2), 0xDEAD);
+
+  // Begin marker, two entries, commit marker.
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 4);
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]) + FlashFairyPP::kPageHeaderLines;
+  EXPECT_EQ(lines[0], 0xFFFE0002);
+  EXPECT_EQ(lines[1], 0x0001AFFE);
+  EXPECT_EQ(lines[2], 0x0002DEAD);
+  EXPECT_EQ(lines[3], 0xFFFD0002);
+
+  // Markers are not values.
+  ::testing::StrictMock<VisitorMock> v;
+  EXPECT_CALL(v, BracketOperator(1, 0xAFFE));
+  EXPECT_CALL(v, BracketOperator(2, 0xDEAD));
+  flashFairy.visitEntries(v);
+  EXPECT_EQ(flashFairy.getValue(FlashFairyPP::kBatchBeginKey), FlashFairyPP::npos);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(1), 0xAFFE);
+  EXPECT_EQ(flashFairy2.getValue(2), 0xDEAD);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 4);
+}
+
+TEST_F(VirtualFlashFixture, Batch_DropsUnchanged) {
+  EXPECT_TRUE(flashFairy.setValue(1, 0xBEEF));
+  EXPECT_TRUE(flashFairy.setValue(2, 0xDEAD));
+
+  FlashFairyPP::WriteBatch<4> batch;
+  batch.setValue(1, 0xBEEF);
+  batch.setValue(2, 0xDEAD);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2);
+
+  batch.setValue(1, 0xBEEF);
+  batch.setValue(2, 0x1234);
+  batch.setValue(3, 0x5678);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+  EXPECT_EQ(batch.size(), 2);
+  EXPECT_FALSE(batch.contains(1));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2 - 4);
+  EXPECT_EQ(flashFairy.getValue(1), 0xBEEF);
+  EXPECT_EQ(flashFairy.getValue(2), 0x1234);
+  EXPECT_EQ(flashFairy.getValue(3), 0x5678);
+}
+
+TEST_F(VirtualFlashFixture, Batch_CompactsOnce) {
+  const std::size_t numWrites = kDataLines - 2;
+  for (std::size_t i = 0; i < numWrites; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % 10, i));
+  }
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 2);
+
+  FlashFairyPP::WriteBatch<3> batch;
+  batch.setValue(0, 0xBEEF);
+  batch.setValue(1, 0xDEAD);
+  batch.setValue(20, 0xAFFE);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+
+  pageIsEmpty(pages[0]);
+  // Eight keys survived compaction, followed by the batch.
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 8 - 5);
+  EXPECT_EQ(flashFairy.getValue(0), 0xBEEF);
+  EXPECT_EQ(flashFairy.getValue(1), 0xDEAD);
+  EXPECT_EQ(flashFairy.getValue(20), 0xAFFE);
+  for (std::size_t i = numWrites - 10; i < numWrites; ++i) {
+    if (i % 10 > 1) {
+      EXPECT_EQ(flashFairy.getValue(i % 10), i);
+    }
+  }
+}
+
+TEST_F(VirtualFlashFixture, Batch_DoesNotFit) {
+  for (FlashFairyPP::key_type key = 0; key < kDataLines; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+
+  FlashFairyPP::WriteBatch<2> batch;
+  batch.setValue(0, 0xBEEF);
+  EXPECT_FALSE(flashFairy.setValues(batch));
+
+  // Nothing was lost.
+  pageIsEmpty(pages[1]);
+  for (FlashFairyPP::key_type key = 0; key < kDataLines; ++key) {
+    EXPECT_EQ(flashFairy.getValue(key), key);
+  }
+}
+
+TEST_F(VirtualFlashFixture, Batch_PowerLossBeforeCommit) {
+  EXPECT_TRUE(flashFairy.setValue(1, 0xBEEF));
+
+  FlashFairyPP::WriteBatch<2> batch;
+  batch.setValue(1, 0xDEAD);
+  batch.setValue(2, 0xAFFE);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+
+  // Simulate a power loss before the commit marker was written.
+  memset(pages[0] + kDataOffset + 4 * 4, 0xFF, 4);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(1), 0xBEEF);
+  EXPECT_EQ(flashFairy2.getValue(2), FlashFairyPP::npos);
+
+  // The incomplete batch got an abort marker instead of the commit marker.
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]) + FlashFairyPP::kPageHeaderLines;
+  EXPECT_EQ(lines[4], 0xFFFC0002);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 5);
+
+  ::testing::StrictMock<VisitorMock> v;
+  EXPECT_CALL(v, BracketOperator(1, 0xBEEF));
+  flashFairy2.visitEntries(v);
+
+  // Later batches still commit normally.
+  EXPECT_TRUE(flashFairy2.setValues(batch));
+  EXPECT_EQ(flashFairy2.getValue(1), 0xDEAD);
+  EXPECT_EQ(flashFairy2.getValue(2), 0xAFFE);
+
+  FlashFairyPP flashFairy3;
+  flashFairy3.initialize(config);
+  EXPECT_EQ(flashFairy3.getValue(1), 0xDEAD);
+  EXPECT_EQ(flashFairy3.getValue(2), 0xAFFE);
+  EXPECT_EQ(flashFairy3.numEntriesLeftOnActivePage(), kDataLines - 9);
+}
+
+TEST_F(VirtualFlashFixture, Batch_PowerLossDuringEntries) {
+  FlashFairyPP::WriteBatch<3> batch;
+  batch.setValue(1, 0xDEAD);
+  batch.setValue(2, 0xAFFE);
+  batch.setValue(3, 0xBEEF);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+
+  // Only the begin marker and the first entry made it to flash.
+  memset(pages[0] + kDataOffset + 2 * 4, 0xFF, 3 * 4);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(1), FlashFairyPP::npos);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 5);
+
+  // Survives compaction: the aborted entry is not copied.
+  for (std::size_t i = 0; i < kDataLines - 5; ++i) {
+    ASSERT_TRUE(flashFairy2.setValue(10, i));
+  }
+  EXPECT_TRUE(flashFairy2.setValue(11, 0));
+  pageIsEmpty(pages[0]);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 2);
+  EXPECT_EQ(flashFairy2.getValue(1), FlashFairyPP::npos);
+}
+
 }  // namespace FlashFairyPP
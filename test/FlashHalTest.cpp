@@ -0,0 +1,151 @@
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+/// Forwards to the C hooks, programs up to eight lines at once and checks that flash is unlocked.
+struct BulkFlashHal {
+  constexpr static const std::size_t kBulkProgramLines = 8;
+
+  static bool unlocked;
+  static std::size_t numUnlocks;
+  static std::size_t numBulkPrograms;
+  static std::size_t numBulkLines;
+
+  static void unlock() {
+    EXPECT_FALSE(unlocked);
+    unlocked = true;
+    ++numUnlocks;
+  }
+  static void lock() {
+    EXPECT_TRUE(unlocked);
+    unlocked = false;
+  }
+  static void erasePage(void* pagePtr) {
+    EXPECT_TRUE(unlocked);
+    FlashFairy_Erase_Page(pagePtr);
+  }
+  static void programLine(void* linePtr, const uint32_t line) {
+    EXPECT_TRUE(unlocked);
+    FlashFairy_Write_Word(linePtr, line);
+  }
+  static void programLines(uint32_t* linePtr, const uint32_t* lines, const std::size_t count) {
+    EXPECT_TRUE(unlocked);
+    EXPECT_GT(count, 0);
+    EXPECT_LE(count, kBulkProgramLines);
+    for (std::size_t i = 0; i < count; ++i) {
+      FlashFairy_Write_Word(linePtr + i, lines[i]);
+    }
+    ++numBulkPrograms;
+    numBulkLines += count;
+  }
+};
+
+constexpr const std::size_t BulkFlashHal::kBulkProgramLines;
+bool BulkFlashHal::unlocked = false;
+std::size_t BulkFlashHal::numUnlocks = 0;
+std::size_t BulkFlashHal::numBulkPrograms = 0;
+std::size_t BulkFlashHal::numBulkLines = 0;
+
+struct BulkTraits : public Traits<> {
+  using FlashHal = BulkFlashHal;
+};
+
+using BulkFlashFairy = BasicFlashFairyPP<BulkTraits>;
+
+class FlashHalFixture : public BasicVirtualFlashFixture<BulkFlashFairy> {
+ public:
+  void SetUp() override {
+    BulkFlashHal::unlocked = false;
+    BulkFlashHal::numUnlocks = 0;
+    BulkFlashHal::numBulkPrograms = 0;
+    BulkFlashHal::numBulkLines = 0;
+    BasicVirtualFlashFixture<BulkFlashFairy>::SetUp();
+  }
+};
+
+TEST(FlashHal, BulkProgramLines) {
+  EXPECT_EQ(FlashFairyPP::kBulkProgramLines, 0);
+  EXPECT_EQ(BulkFlashFairy::kBulkProgramLines, 8);
+}
+
+TEST_F(FlashHalFixture, Batch_ProgramsInBulk) {
+  BulkFlashFairy::WriteBatch<10> batch;
+  for (BulkFlashFairy::key_type key = 0; key < 10; ++key) {
+    ASSERT_TRUE(batch.setValue(key, key + 100));
+  }
+  ASSERT_TRUE(flashFairy.setValues(batch));
+  EXPECT_FALSE(BulkFlashHal::unlocked);
+
+  // Begin, ten entries and commit in two bulk operations.
+  EXPECT_EQ(BulkFlashHal::numUnlocks, 1);
+  EXPECT_EQ(BulkFlashHal::numBulkPrograms, 2);
+  EXPECT_EQ(BulkFlashHal::numBulkLines, 12);
+
+  BulkFlashFairy flashFairy2;
+  flashFairy2.initialize(config);
+  for (BulkFlashFairy::key_type key = 0; key < 10; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(key), key + 100);
+  }
+}
+
+TEST_F(FlashHalFixture, Compaction_ProgramsInBulk) {
+  constexpr static const std::size_t kNumColdKeys = 50;
+  for (BulkFlashFairy::key_type key = 0; key < kNumColdKeys; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key + 1000));
+  }
+  const std::size_t entriesLeft = flashFairy.numEntriesLeftOnActivePage();
+  for (std::size_t i = 0; i < entriesLeft; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(200, i));
+  }
+  BulkFlashHal::numBulkPrograms = 0;
+  BulkFlashHal::numBulkLines = 0;
+
+  // The switch copies the cold keys in bulk, the new value is programmed on its own.
+  ASSERT_TRUE(flashFairy.setValue(200, 0xBEEF));
+  EXPECT_EQ(eraseCounts.size(), 1);
+  EXPECT_EQ(BulkFlashHal::numBulkLines, kNumColdKeys);
+  EXPECT_EQ(BulkFlashHal::numBulkPrograms, (kNumColdKeys + 7) / 8);
+  EXPECT_FALSE(BulkFlashHal::unlocked);
+
+  BulkFlashFairy flashFairy2;
+  flashFairy2.initialize(config);
+  for (BulkFlashFairy::key_type key = 0; key < kNumColdKeys; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(key), key + 1000);
+  }
+  EXPECT_EQ(flashFairy2.getValue(200), 0xBEEF);
+}
+
+TEST_F(FlashHalFixture, Record_ProgramsInBulk) {
+  const char text[] = "seventeen bytes..";
+  ASSERT_TRUE(flashFairy.setRecord(3, text, sizeof(text)));
+  // Six payload lines and the trailer.
+  EXPECT_EQ(BulkFlashHal::numBulkPrograms, 1);
+  EXPECT_EQ(BulkFlashHal::numBulkLines, 7);
+
+  char readBack[sizeof(text)] = {};
+  EXPECT_TRUE(flashFairy.getRecord(3, readBack, sizeof(readBack)));
+  EXPECT_STREQ(readBack, text);
+}
+
+TEST_F(FlashHalFixture, TwoBackends) {
+  // A second store on the default backend in the same binary.
+  alignas(4) uint8_t otherPages[2][1024];
+  memset(otherPages, 0xFF, sizeof(otherPages));
+  FlashFairyPP::Config_t otherConfig;
+  for (std::size_t i = 0; i < 2; ++i) {
+    otherConfig.pages[i] = reinterpret_cast<FlashFairyPP::PagePtr_t>(otherPages[i]);
+    pageSizes[otherPages[i]] = sizeof(otherPages[i]);
+  }
+  FlashFairyPP other;
+  other.initialize(otherConfig);
+
+  ASSERT_TRUE(flashFairy.setValue(1, 0xBEEF));
+  ASSERT_TRUE(other.setValue(1, 0xDEAD));
+  EXPECT_EQ(BulkFlashHal::numUnlocks, 1);
+  EXPECT_EQ(flashFairy.getValue(1), 0xBEEF);
+  EXPECT_EQ(other.getValue(1), 0xDEAD);
+}
+
+}  // namespace FlashFairyPP
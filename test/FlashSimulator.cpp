@@ -0,0 +1,52 @@
+#include "FlashSimulator.h"
+
+namespace FlashFairyPP {
+
+void FlashSimulator::unlock() { unlocked_ = true; }
+
+void FlashSimulator::lock() { unlocked_ = false; }
+
+void FlashSimulator::erasePage(void* pagePtr) {
+  uint8_t* bytes = static_cast<uint8_t*>(pagePtr);
+  if (!beginOperation(bytes, pageSize_)) {
+    return;
+  }
+  const std::size_t pageIndex = static_cast<std::size_t>(bytes - memory_) / pageSize_;
+  memset(bytes, 0xFF, pageSize_);
+  ++eraseCounts_[pageIndex];
+  ++numErases_;
+  nowNs_ += timing_.eraseNs;
+}
+
+void FlashSimulator::powerOn() {
+  powerCutAt_ = static_cast<std::size_t>(-1);
+  unlocked_ = false;
+}
+
+bool FlashSimulator::beginOperation(const uint8_t* bytes, const std::size_t size) {
+  ++numOperations_;
+  if (numOperations_ > powerCutAt_) {
+    return false;
+  }
+  if (!unlocked_) {
+    fault(Fault::kLocked);
+    return false;
+  }
+  if (bytes < memory_ || bytes >= memory_ + pageSize_ * numPages_) {
+    fault(Fault::kOutOfRange);
+    return false;
+  }
+  // Lines are aligned to their size, erases to the page size.
+  if (static_cast<std::size_t>(bytes - memory_) % size != 0) {
+    fault(Fault::kMisaligned);
+    return false;
+  }
+  return true;
+}
+
+void FlashSimulator::fault(const Fault fault) {
+  ++numFaults_;
+  lastFault_ = fault;
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,132 @@
+#ifndef __FLASHSIMULATOR_H__
+#define __FLASHSIMULATOR_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace FlashFairyPP {
+
+/**
+ * \brief Simulated NOR flash, e.g., the internal flash of an STM32.
+ *
+ * Models the constraints of real flash on top of a plain memory area:
+ *  - Erasing sets a whole page to 0xFF, programming can only clear bits. Programming a line that is not erased is a
+ *    double-program fault; with allowReprogram (as on most external NOR parts) only setting bits is a fault.
+ *  - Programming and erasing require flash to be unlocked.
+ *  - Every erase and program operation advances a virtual clock by a configurable latency.
+ *  - Erase counters per page.
+ *  - A power cut after a given number of operations: that operation and every later one is dropped until powerOn().
+ *
+ * Faulty operations are counted and program only the bits that flash could clear.
+ */
+class FlashSimulator {
+ public:
+  /// Latencies in nanoseconds, defaults are typical for STM32F1.
+  struct Timing {
+    uint64_t eraseNs = 22000000;
+    uint64_t programNs = 52500;
+  };
+
+  enum class Fault { kNone, kLocked, kOutOfRange, kMisaligned, kSetsBits, kDoubleProgram };
+
+  FlashSimulator(uint8_t* memory, std::size_t pageSize, std::size_t numPages, Timing timing)
+      : memory_(memory), pageSize_(pageSize), numPages_(numPages), timing_(timing), eraseCounts_(numPages, 0) {
+    memset(memory_, 0xFF, pageSize_ * numPages_);
+  }
+  FlashSimulator(uint8_t* memory, std::size_t pageSize, std::size_t numPages)
+      : FlashSimulator(memory, pageSize, numPages, Timing()) {}
+
+  uint8_t* page(std::size_t pageIndex) const { return memory_ + pageIndex * pageSize_; }
+  std::size_t pageSize() const { return pageSize_; }
+  std::size_t numPages() const { return numPages_; }
+
+  /// Whether bits may be cleared in lines that were already programmed.
+  void setAllowReprogram(bool allowReprogram) { allowReprogram_ = allowReprogram; }
+
+  void unlock();
+  void lock();
+  void erasePage(void* pagePtr);
+
+  template <typename Line>
+  void program(void* linePtr, const Line line) {
+    uint8_t* bytes = static_cast<uint8_t*>(linePtr);
+    if (!beginOperation(bytes, sizeof(Line))) {
+      return;
+    }
+    Line stored;
+    memcpy(&stored, bytes, sizeof(Line));
+    if (stored != static_cast<Line>(~static_cast<Line>(0)) && !allowReprogram_) {
+      fault(Fault::kDoubleProgram);
+    } else if ((line & ~stored) != 0) {
+      fault(Fault::kSetsBits);
+    }
+    stored &= line;
+    memcpy(bytes, &stored, sizeof(Line));
+    ++numPrograms_;
+    nowNs_ += timing_.programNs;
+  }
+
+  /// Drop the numOperations + 1st program or erase operation and every later one, until powerOn().
+  void cutPowerAfter(std::size_t numOperations) { powerCutAt_ = numOperations_ + numOperations; }
+  bool isPowered() const { return numOperations_ < powerCutAt_; }
+  /// Restore power. Flash keeps its contents and is locked again.
+  void powerOn();
+
+  std::size_t eraseCount(std::size_t pageIndex) const { return eraseCounts_[pageIndex]; }
+  std::size_t numErases() const { return numErases_; }
+  std::size_t numPrograms() const { return numPrograms_; }
+  /// Program and erase operations so far, including dropped ones.
+  std::size_t numOperations() const { return numOperations_; }
+  uint64_t nowNs() const { return nowNs_; }
+
+  std::size_t numFaults() const { return numFaults_; }
+  Fault lastFault() const { return lastFault_; }
+
+ private:
+  /// Check an operation on size bytes at bytes. Returns whether it is executed.
+  bool beginOperation(const uint8_t* bytes, std::size_t size);
+  void fault(Fault fault);
+
+  uint8_t* memory_;
+  std::size_t pageSize_;
+  std::size_t numPages_;
+  Timing timing_;
+  bool allowReprogram_ = false;
+  bool unlocked_ = false;
+
+  std::vector<std::size_t> eraseCounts_;
+  std::size_t numErases_ = 0;
+  std::size_t numPrograms_ = 0;
+  std::size_t numOperations_ = 0;
+  std::size_t powerCutAt_ = static_cast<std::size_t>(-1);
+  uint64_t nowNs_ = 0;
+
+  std::size_t numFaults_ = 0;
+  Fault lastFault_ = Fault::kNone;
+};
+
+/**
+ * \brief Flash backend, see FlashHal.h, that runs on a FlashSimulator.
+ *
+ * Backends are stateless, so the simulator is selected through a static pointer. Tag tells apart backends of
+ * stores that run on different simulators.
+ */
+template <class Tag = void>
+struct SimulatedFlashHal {
+  static FlashSimulator* simulator;
+
+  static void unlock() { simulator->unlock(); }
+  static void lock() { simulator->lock(); }
+  static void erasePage(void* pagePtr) { simulator->erasePage(pagePtr); }
+  static void programLine(void* linePtr, const uint32_t line) { simulator->program(linePtr, line); }
+  static void programLine(void* linePtr, const uint64_t line) { simulator->program(linePtr, line); }
+};
+
+template <class Tag>
+FlashSimulator* SimulatedFlashHal<Tag>::simulator = nullptr;
+
+}  // namespace FlashFairyPP
+
+#endif  // __FLASHSIMULATOR_H__
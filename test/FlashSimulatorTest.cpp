@@ -0,0 +1,306 @@
+#include <algorithm>
+
+#include "FlashFairyPP/FlashFairyPP.h"
+#include "FlashSimulator.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+TEST(FlashSimulator, ProgramOnlyClearsBits) {
+  alignas(8) uint8_t memory[2 * 64];
+  FlashSimulator simulator(memory, 64, 2);
+  uint32_t* lines = reinterpret_cast<uint32_t*>(memory);
+
+  simulator.program(&lines[0], uint32_t(0x12345678));
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kLocked);
+  EXPECT_EQ(lines[0], 0xFFFFFFFF);
+
+  simulator.unlock();
+  simulator.program(&lines[0], uint32_t(0x12345678));
+  EXPECT_EQ(lines[0], 0x12345678);
+  EXPECT_EQ(simulator.numFaults(), 1);
+
+  // A second program operation on a line is a fault even if it only clears bits.
+  simulator.program(&lines[0], uint32_t(0x02305070));
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kDoubleProgram);
+  EXPECT_EQ(lines[0], 0x02305070);
+
+  simulator.setAllowReprogram(true);
+  simulator.program(&lines[0], uint32_t(0x02305070));
+  EXPECT_EQ(simulator.numFaults(), 2);
+  simulator.program(&lines[0], uint32_t(0xFFFFFFF0));
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kSetsBits);
+  EXPECT_EQ(simulator.numFaults(), 3);
+  EXPECT_EQ(lines[0], 0x02305070);
+
+  simulator.program(memory + 2, uint32_t(0));
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kMisaligned);
+  simulator.program(memory + 2 * 64, uint32_t(0));
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kOutOfRange);
+}
+
+TEST(FlashSimulator, EraseCountsAndClock) {
+  alignas(8) uint8_t memory[2 * 64];
+  FlashSimulator::Timing timing;
+  timing.eraseNs = 1000;
+  timing.programNs = 10;
+  FlashSimulator simulator(memory, 64, 2, timing);
+
+  simulator.unlock();
+  simulator.program(simulator.page(1), uint64_t(0));
+  simulator.erasePage(simulator.page(1));
+  simulator.erasePage(simulator.page(1));
+  simulator.erasePage(simulator.page(1) + 8);
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kMisaligned);
+
+  EXPECT_EQ(simulator.eraseCount(0), 0);
+  EXPECT_EQ(simulator.eraseCount(1), 2);
+  EXPECT_EQ(simulator.numErases(), 2);
+  EXPECT_EQ(simulator.numPrograms(), 1);
+  EXPECT_EQ(simulator.nowNs(), 2 * 1000 + 10);
+  EXPECT_EQ(memory[64], 0xFF);
+}
+
+TEST(FlashSimulator, PowerCut) {
+  alignas(8) uint8_t memory[64];
+  FlashSimulator simulator(memory, 64, 1);
+  uint32_t* lines = reinterpret_cast<uint32_t*>(memory);
+
+  simulator.unlock();
+  simulator.cutPowerAfter(2);
+  for (uint32_t i = 0; i < 4; ++i) {
+    simulator.program(&lines[i], i);
+  }
+  EXPECT_FALSE(simulator.isPowered());
+  EXPECT_EQ(lines[1], 1);
+  EXPECT_EQ(lines[2], 0xFFFFFFFF);
+  EXPECT_EQ(simulator.numPrograms(), 2);
+  EXPECT_EQ(simulator.numOperations(), 4);
+
+  simulator.powerOn();
+  simulator.program(&lines[2], uint32_t(2));
+  EXPECT_EQ(simulator.lastFault(), FlashSimulator::Fault::kLocked);
+}
+
+template <std::size_t NumPages, std::size_t CompactionStepEntries>
+struct SimulatedTraits : public Traits<> {
+  constexpr static const std::size_t kNumPages = NumPages;
+  constexpr static const std::size_t kCompactionStepEntries = CompactionStepEntries;
+  using FlashHal = SimulatedFlashHal<>;
+};
+
+template <class FlashFairyT>
+class FlashSimulatorFixture : public ::testing::Test {
+ public:
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  constexpr static const std::size_t kPageSize = FlashFairyT::Config_t::pageSize;
+  constexpr static const std::size_t kNumColdKeys = 30;
+  constexpr static const key_type kHotKey = 200;
+  constexpr static const key_type kFirstBatchKey = 100;
+  constexpr static const std::size_t kBatchSize = 4;
+
+  void SetUp() override {
+    SimulatedFlashHal<>::simulator = &simulator;
+    for (std::size_t i = 0; i < FlashFairyT::kNumPages; ++i) {
+      config.pages[i] = reinterpret_cast<typename FlashFairyT::PagePtr_t>(simulator.page(i));
+    }
+  }
+
+  void TearDown() override { SimulatedFlashHal<>::simulator = nullptr; }
+
+  /// A third of the cold keys (all of them in round 0), a batch and the hot key.
+  void writeRound(FlashFairyT& flashFairy, const std::size_t round) {
+    for (key_type key = 0; key < kNumColdKeys; ++key) {
+      if (round == 0 || key % 3 == round % 3) {
+        flashFairy.setValue(key, static_cast<value_type>(round));
+      }
+    }
+    typename FlashFairyT::template WriteBatch<kBatchSize> batch;
+    for (key_type key = 0; key < kBatchSize; ++key) {
+      batch.setValue(static_cast<key_type>(kFirstBatchKey + key), static_cast<value_type>(round));
+    }
+    flashFairy.setValues(batch);
+    for (std::size_t i = 0; i < 20; ++i) {
+      flashFairy.setValue(kHotKey, static_cast<value_type>(round * 100 + i));
+    }
+    flashFairy.poll();
+  }
+
+  alignas(8) uint8_t memory[FlashFairyT::kNumPages * kPageSize];
+  FlashSimulator simulator{memory, kPageSize, FlashFairyT::kNumPages};
+  typename FlashFairyT::Config_t config;
+};
+
+using SimulatedTypes = ::testing::Types<BasicFlashFairyPP<SimulatedTraits<2, 0>>,
+                                        BasicFlashFairyPP<SimulatedTraits<3, 0>>,
+                                        BasicFlashFairyPP<SimulatedTraits<3, 2>>>;
+TYPED_TEST_SUITE(FlashSimulatorFixture, SimulatedTypes);
+
+TYPED_TEST(FlashSimulatorFixture, NoFaults) {
+  TypeParam flashFairy;
+  flashFairy.initialize(this->config);
+  for (std::size_t round = 0; round < 100; ++round) {
+    this->writeRound(flashFairy, round);
+  }
+  EXPECT_EQ(this->simulator.numFaults(), 0);
+  EXPECT_GT(this->simulator.numErases(), TypeParam::kNumPages);
+  EXPECT_EQ(flashFairy.getValue(this->kHotKey), 99 * 100 + 19);
+
+  // Erases are spread evenly.
+  std::size_t minErases = this->simulator.eraseCount(0);
+  std::size_t maxErases = minErases;
+  for (std::size_t page = 0; page < TypeParam::kNumPages; ++page) {
+    minErases = std::min(minErases, this->simulator.eraseCount(page));
+    maxErases = std::max(maxErases, this->simulator.eraseCount(page));
+  }
+  EXPECT_LE(maxErases - minErases, 1);
+
+  const FlashSimulator::Timing timing;
+  EXPECT_EQ(this->simulator.nowNs(),
+            this->simulator.numErases() * timing.eraseNs + this->simulator.numPrograms() * timing.programNs);
+}
+
+TYPED_TEST(FlashSimulatorFixture, PowerCut_Recovers) {
+  // Learn how many flash operations the workload takes without a power cut.
+  std::size_t numOperations = 0;
+  {
+    TypeParam flashFairy;
+    flashFairy.initialize(this->config);
+    this->writeRound(flashFairy, 0);
+    const std::size_t before = this->simulator.numOperations();
+    for (std::size_t round = 1; round < 30; ++round) {
+      this->writeRound(flashFairy, round);
+    }
+    numOperations = this->simulator.numOperations() - before;
+  }
+
+  for (std::size_t cut = 0; cut < numOperations; cut += 7) {
+    this->simulator.powerOn();
+    this->simulator.unlock();
+    for (std::size_t page = 0; page < TypeParam::kNumPages; ++page) {
+      this->simulator.erasePage(this->simulator.page(page));
+    }
+    this->simulator.lock();
+
+    {
+      TypeParam flashFairy;
+      flashFairy.initialize(this->config);
+      this->writeRound(flashFairy, 0);
+      this->simulator.cutPowerAfter(cut);
+      for (std::size_t round = 1; round < 30; ++round) {
+        this->writeRound(flashFairy, round);
+      }
+    }
+
+    this->simulator.powerOn();
+    const std::size_t numFaults = this->simulator.numFaults();
+    TypeParam flashFairy;
+    flashFairy.initialize(this->config);
+
+    // Batches are all or nothing, the hot key holds a value of a round that was reached.
+    const typename TypeParam::value_type batchValue = flashFairy.getValue(this->kFirstBatchKey);
+    for (typename TypeParam::key_type key = 1; key < this->kBatchSize; ++key) {
+      ASSERT_EQ(flashFairy.getValue(static_cast<typename TypeParam::key_type>(this->kFirstBatchKey + key)),
+                batchValue)
+          << "cut: " << cut;
+    }
+    ASSERT_LT(batchValue, 30) << "cut: " << cut;
+    ASSERT_LT(flashFairy.getValue(this->kHotKey), 30 * 100) << "cut: " << cut;
+    for (typename TypeParam::key_type key = 0; key < this->kNumColdKeys; ++key) {
+      ASSERT_NE(flashFairy.getValue(key), TypeParam::npos) << "cut: " << cut << ", key: " << key;
+    }
+
+    // Writing continues without faults.
+    for (std::size_t round = 30; round < 40; ++round) {
+      this->writeRound(flashFairy, round);
+    }
+    ASSERT_EQ(this->simulator.numFaults(), numFaults)
+        << "cut: " << cut << ", fault: " << static_cast<int>(this->simulator.lastFault());
+    EXPECT_EQ(flashFairy.getValue(this->kHotKey), 39 * 100 + 19);
+    TypeParam flashFairy2;
+    flashFairy2.initialize(this->config);
+    EXPECT_EQ(flashFairy2.getValue(this->kHotKey), 39 * 100 + 19);
+  }
+  EXPECT_EQ(this->simulator.numFaults(), 0);
+}
+
+TYPED_TEST(FlashSimulatorFixture, PowerCut_BatchPageSwitch) {
+  using key_type = typename TypeParam::key_type;
+  using value_type = typename TypeParam::value_type;
+
+  // Fill the active page until the next batch needs a page switch, then count the operations of that batch.
+  auto prepare = [this](TypeParam& flashFairy) {
+    this->simulator.powerOn();
+    this->simulator.unlock();
+    for (std::size_t page = 0; page < TypeParam::kNumPages; ++page) {
+      this->simulator.erasePage(this->simulator.page(page));
+    }
+    this->simulator.lock();
+    flashFairy.initialize(this->config);
+    for (std::size_t round = 0; round < 3; ++round) {
+      this->writeRound(flashFairy, round);
+    }
+    std::size_t i = 0;
+    while (flashFairy.numEntriesLeftOnActivePage() >= this->kBatchSize + 2) {
+      flashFairy.setValue(this->kHotKey, static_cast<value_type>(i++));
+    }
+  };
+  auto writeBatch = [this](TypeParam& flashFairy) {
+    typename TypeParam::template WriteBatch<this->kBatchSize> batch;
+    for (key_type key = 0; key < this->kBatchSize; ++key) {
+      batch.setValue(static_cast<key_type>(this->kFirstBatchKey + key), 1000);
+    }
+    flashFairy.setValues(batch);
+  };
+
+  std::size_t numOperations = 0;
+  {
+    TypeParam flashFairy;
+    prepare(flashFairy);
+    const std::size_t before = this->simulator.numOperations();
+    writeBatch(flashFairy);
+    numOperations = this->simulator.numOperations() - before;
+  }
+  ASSERT_GT(numOperations, this->kBatchSize + 2);
+
+  // Cut power at every flash operation of the batch, including those of the page switch.
+  for (std::size_t cut = 0; cut <= numOperations; ++cut) {
+    {
+      TypeParam flashFairy;
+      prepare(flashFairy);
+      this->simulator.cutPowerAfter(cut);
+      writeBatch(flashFairy);
+    }
+    this->simulator.powerOn();
+    const std::size_t numFaults = this->simulator.numFaults();
+    TypeParam flashFairy;
+    flashFairy.initialize(this->config);
+    const value_type batchValue = flashFairy.getValue(this->kFirstBatchKey);
+    for (key_type key = 1; key < this->kBatchSize; ++key) {
+      ASSERT_EQ(flashFairy.getValue(static_cast<key_type>(this->kFirstBatchKey + key)), batchValue)
+          << "cut: " << cut;
+    }
+
+    // Values written after the remount survive the following page switches.
+    ASSERT_TRUE(flashFairy.setValue(6, 3000));
+    for (std::size_t i = 0; i < 3 * TypeParam::kNumPages * 256; ++i) {
+      ASSERT_TRUE(flashFairy.setValue(this->kHotKey, static_cast<value_type>(i)));
+      ASSERT_EQ(flashFairy.getValue(6), 3000) << "cut: " << cut << ", i: " << i;
+    }
+    TypeParam flashFairy2;
+    flashFairy2.initialize(this->config);
+    ASSERT_EQ(flashFairy2.getValue(6), 3000) << "cut: " << cut;
+    ASSERT_EQ(flashFairy2.getValue(this->kFirstBatchKey), batchValue) << "cut: " << cut;
+    for (key_type key = 0; key < this->kNumColdKeys; ++key) {
+      if (key != 6) {
+        ASSERT_NE(flashFairy2.getValue(key), TypeParam::npos) << "cut: " << cut << ", key: " << key;
+      }
+    }
+    ASSERT_EQ(this->simulator.numFaults(), numFaults) << "cut: " << cut;
+  }
+}
+
+}  // namespace FlashFairyPP
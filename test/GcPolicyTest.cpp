@@ -0,0 +1,193 @@
+#include <cstdlib>
+
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+template <std::size_t NumPages, std::size_t CompactionStepEntries>
+struct GcTraits : public Traits<> {
+  constexpr static const std::size_t kNumPages = NumPages;
+  constexpr static const std::size_t kCompactionStepEntries = CompactionStepEntries;
+};
+
+struct IndexedGcTraits : public Traits<> {
+  template <typename Key, typename Value, std::size_t NumIndexedKeys, std::size_t NumPages, std::size_t LinesPerPage>
+  using KeyIndex = ValueCacheIndex<Key, Value, NumIndexedKeys, NumPages, LinesPerPage>;
+};
+
+template <class FlashFairyT>
+class LineCountFixture : public BasicVirtualFlashFixture<FlashFairyT> {
+ public:
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  /// The counts that initialize() finds for the current contents of flash.
+  LineCounts recount() {
+    FlashFairyT flashFairy2;
+    flashFairy2.initialize(this->config);
+    return flashFairy2.getLineCounts();
+  }
+
+  void expectCountsMatchFlash() {
+    const LineCounts counts = this->flashFairy.getLineCounts();
+    const LineCounts flashCounts = recount();
+    EXPECT_EQ(counts.numLiveLines, flashCounts.numLiveLines);
+    EXPECT_EQ(counts.numStaleLines, flashCounts.numStaleLines);
+    EXPECT_EQ(counts.numFreeLines, flashCounts.numFreeLines);
+  }
+
+  /// Values, batches and records on few keys, so that the ring wraps several times.
+  void churn(const std::size_t numWrites) {
+    for (std::size_t i = 0; i < numWrites; ++i) {
+      const key_type key = static_cast<key_type>(rand() % 30);
+      switch (rand() % 8) {
+        case 0: {
+          typename FlashFairyT::template WriteBatch<3> batch;
+          batch.setValue(key, static_cast<value_type>(i));
+          batch.setValue(static_cast<key_type>(key + 1), static_cast<value_type>(i));
+          batch.setValue(static_cast<key_type>(key + 2), 7);
+          ASSERT_TRUE(this->flashFairy.setValues(batch));
+          break;
+        }
+        case 1:
+          ASSERT_TRUE(this->flashFairy.setRecord(key, static_cast<uint64_t>(i)));
+          break;
+        default:
+          ASSERT_TRUE(this->flashFairy.setValue(key, static_cast<value_type>(i % 5)));
+          break;
+      }
+    }
+  }
+};
+
+using LineCountTypes = ::testing::Types<FlashFairyPP, BasicFlashFairyPP<GcTraits<4, 0>>,
+                                        BasicFlashFairyPP<GcTraits<4, 2>>, BasicFlashFairyPP<IndexedGcTraits>>;
+TYPED_TEST_SUITE(LineCountFixture, LineCountTypes);
+
+TYPED_TEST(LineCountFixture, Writes) {
+  auto& flashFairy = this->flashFairy;
+  EXPECT_EQ(flashFairy.numLiveLines(), 0);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 0);
+  EXPECT_FALSE(flashFairy.compactNow());
+
+  ASSERT_TRUE(flashFairy.setValue(1, 10));
+  ASSERT_TRUE(flashFairy.setValue(2, 20));
+  ASSERT_TRUE(flashFairy.setValue(2, 20));
+  EXPECT_EQ(flashFairy.numLiveLines(), 2);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 0);
+
+  ASSERT_TRUE(flashFairy.setValue(2, 21));
+  EXPECT_EQ(flashFairy.numLiveLines(), 2);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 1);
+
+  // Two markers and the replaced value of key 1.
+  typename TypeParam::template WriteBatch<2> batch;
+  batch.setValue(1, 11);
+  batch.setValue(3, 30);
+  ASSERT_TRUE(flashFairy.setValues(batch));
+  EXPECT_EQ(flashFairy.numLiveLines(), 3);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 1 + 3);
+
+  // A record of a header and two payload lines replaces a value, a value replaces the record.
+  ASSERT_TRUE(flashFairy.setRecord(3, uint32_t(0x12345678)));
+  EXPECT_EQ(flashFairy.numLiveLines(), 5);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 5);
+  ASSERT_TRUE(flashFairy.setValue(3, 31));
+  EXPECT_EQ(flashFairy.numLiveLines(), 3);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 8);
+
+  const LineCounts counts = flashFairy.getLineCounts();
+  EXPECT_EQ(counts.numDataLines, TypeParam::kNumPages * (TypeParam::Config_t::pageSize / 4 - 3));
+  EXPECT_EQ(counts.numFreeLines, flashFairy.numEntriesLeftOnActivePage());
+  this->expectCountsMatchFlash();
+}
+
+TYPED_TEST(LineCountFixture, MatchFlashAcrossCompactions) {
+  srand(1);
+  for (std::size_t round = 0; round < 20; ++round) {
+    this->churn(100);
+    this->expectCountsMatchFlash();
+    if (::testing::Test::HasFailure()) {
+      FAIL() << "Round " << round;
+    }
+  }
+  EXPECT_GT(eraseCounts.size(), 1u);
+}
+
+TYPED_TEST(LineCountFixture, CompactNow) {
+  auto& flashFairy = this->flashFairy;
+  srand(2);
+  this->churn(300);
+  for (std::size_t key = 0; key < 10; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(static_cast<typename TypeParam::key_type>(100 + key), key));
+  }
+  const std::size_t liveLines = flashFairy.numLiveLines();
+  const std::size_t staleLines = flashFairy.reclaimableLines();
+  ASSERT_GT(staleLines, 0);
+
+  // Reclaim the whole ring, one page at a time.
+  std::size_t numCompactions = 0;
+  while (flashFairy.reclaimableLines() > 0 && numCompactions < 2 * TypeParam::kNumPages) {
+    const std::size_t staleBefore = flashFairy.reclaimableLines();
+    EXPECT_TRUE(flashFairy.compactNow());
+    EXPECT_LE(flashFairy.reclaimableLines(), staleBefore);
+    EXPECT_FALSE(flashFairy.isCompactionPending());
+    ++numCompactions;
+  }
+  EXPECT_EQ(flashFairy.reclaimableLines(), 0);
+  EXPECT_EQ(flashFairy.numLiveLines(), liveLines);
+  EXPECT_FALSE(flashFairy.compactNow());
+  if (TypeParam::kNumPages == 2) {
+    EXPECT_EQ(numCompactions, 1);
+  }
+  for (std::size_t key = 0; key < 10; ++key) {
+    EXPECT_EQ(flashFairy.getValue(static_cast<typename TypeParam::key_type>(100 + key)), key);
+  }
+  this->expectCountsMatchFlash();
+}
+
+struct StaleRatioTraits : public Traits<> {
+  using GcPolicy = StaleRatioGcPolicy<50, 20>;
+};
+using StaleRatioFixture = BasicVirtualFlashFixture<BasicFlashFairyPP<StaleRatioTraits>>;
+
+TEST(GcPolicy, Policies) {
+  EXPECT_FALSE(NoGcPolicy::shouldCompact(LineCounts{0, 1000, 0, 1000}));
+
+  using StaleRatio = StaleRatioGcPolicy<50, 20>;
+  EXPECT_FALSE(StaleRatio::shouldCompact(LineCounts{10, 10, 100, 500}));
+  EXPECT_TRUE(StaleRatio::shouldCompact(LineCounts{20, 20, 100, 500}));
+  EXPECT_FALSE(StaleRatio::shouldCompact(LineCounts{30, 29, 100, 500}));
+
+  using FreeLines = FreeLinesGcPolicy<100>;
+  EXPECT_FALSE(FreeLines::shouldCompact(LineCounts{100, 50, 100, 500}));
+  EXPECT_TRUE(FreeLines::shouldCompact(LineCounts{100, 50, 50, 500}));
+  // Compacting would not restore the headroom.
+  EXPECT_FALSE(FreeLines::shouldCompact(LineCounts{200, 10, 50, 500}));
+}
+
+TEST_F(StaleRatioFixture, PollCompacts) {
+  for (std::size_t key = 0; key < 20; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  EXPECT_FALSE(flashFairy.poll());
+  EXPECT_TRUE(eraseCounts.empty());
+
+  for (std::size_t i = 0; i < 19; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(1, 100 + i));
+  }
+  EXPECT_FALSE(flashFairy.poll());
+  EXPECT_TRUE(eraseCounts.empty());
+
+  ASSERT_TRUE(flashFairy.setValue(1, 200));
+  EXPECT_EQ(flashFairy.reclaimableLines(), 20);
+  EXPECT_FALSE(flashFairy.poll());
+  EXPECT_EQ(eraseCounts.size(), 1u);
+  EXPECT_EQ(flashFairy.reclaimableLines(), 0);
+  EXPECT_EQ(flashFairy.getValue(1), 200);
+  EXPECT_EQ(flashFairy.getValue(19), 19);
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,130 @@
+#include "FlashSimulator.h"
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+/// Keys 8 to 11 are counters and flag sets.
+struct InPlaceTraits : public Traits<> {
+  constexpr static const std::size_t kFirstInPlaceKey = 8;
+  constexpr static const std::size_t kNumInPlaceKeys = 4;
+};
+using InPlaceFlashFairy = BasicFlashFairyPP<InPlaceTraits>;
+
+using InPlaceFixture = BasicVirtualFlashFixture<InPlaceFlashFairy>;
+
+constexpr static const std::size_t kDataLines = 256 - InPlaceFlashFairy::kPageHeaderLines;
+
+/// Thermometer code of a counter that counts up to 16.
+static InPlaceFlashFairy::value_type thermometer(const unsigned count) {
+  return static_cast<InPlaceFlashFairy::value_type>(0xFFFFu << count);
+}
+
+TEST_F(InPlaceFixture, Counter_ClearsBitsInPlace) {
+  ASSERT_TRUE(flashFairy.setValue(8, thermometer(0)));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
+  const uint32_t* line = reinterpret_cast<const uint32_t*>(pages[0]) + InPlaceFlashFairy::kPageHeaderLines;
+
+  for (unsigned count = 1; count <= 16; ++count) {
+    ASSERT_TRUE(flashFairy.setValue(8, thermometer(count)));
+    EXPECT_EQ(flashFairy.getValue(8), thermometer(count));
+    EXPECT_EQ(*line, 0x00080000u | thermometer(count));
+  }
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
+
+  // Setting bits again appends a line.
+  ASSERT_TRUE(flashFairy.setValue(8, thermometer(0)));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2);
+  EXPECT_EQ(flashFairy.getValue(8), thermometer(0));
+  ASSERT_TRUE(flashFairy.setValue(8, thermometer(3)));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2);
+
+  InPlaceFlashFairy flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(8), thermometer(3));
+}
+
+TEST_F(InPlaceFixture, OtherKeysAppend) {
+  ASSERT_TRUE(flashFairy.setValue(1, 0xFF));
+  ASSERT_TRUE(flashFairy.setValue(1, 0x0F));
+  ASSERT_TRUE(flashFairy.setValue(12, 0xFF));
+  ASSERT_TRUE(flashFairy.setValue(12, 0x0F));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 4);
+}
+
+TEST_F(InPlaceFixture, VisitEntries) {
+  ASSERT_TRUE(flashFairy.setValue(9, 0xFF00));
+  ASSERT_TRUE(flashFairy.setValue(1, 1));
+  ASSERT_TRUE(flashFairy.setValue(9, 0x0F00));
+
+  ::testing::StrictMock<VisitorMock> v;
+  EXPECT_CALL(v, BracketOperator(9, 0x0F00));
+  EXPECT_CALL(v, BracketOperator(1, 1));
+  flashFairy.visitEntries(v);
+}
+
+TEST_F(InPlaceFixture, SwitchPages) {
+  ASSERT_TRUE(flashFairy.setValue(10, 0xFFFF));
+  while (flashFairy.numEntriesLeftOnActivePage() > 0) {
+    const std::size_t entriesLeft = flashFairy.numEntriesLeftOnActivePage();
+    ASSERT_TRUE(flashFairy.setValue(1, static_cast<InPlaceFlashFairy::value_type>(entriesLeft)));
+  }
+  ASSERT_TRUE(flashFairy.setValue(10, 0xFFFE));
+  ASSERT_TRUE(flashFairy.setValue(1, 0));
+
+  // The newest line of the key is on the previous page, so the next update appends to the active page.
+  ASSERT_TRUE(flashFairy.setValue(10, 0xFFFC));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 2);
+
+  // Fill the second page so that the first page is compacted, which copies the updated value.
+  ASSERT_TRUE(flashFairy.setValue(10, 0xFFF8));
+  while (flashFairy.numEntriesLeftOnActivePage() > 0) {
+    const std::size_t entriesLeft = flashFairy.numEntriesLeftOnActivePage();
+    ASSERT_TRUE(flashFairy.setValue(1, static_cast<InPlaceFlashFairy::value_type>(entriesLeft)));
+  }
+  ASSERT_TRUE(flashFairy.setValue(1, 0xBEEF));
+  EXPECT_EQ(flashFairy.getValue(10), 0xFFF8);
+  ASSERT_TRUE(flashFairy.setValue(10, 0xFFF0));
+
+  InPlaceFlashFairy flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(10), 0xFFF0);
+  EXPECT_EQ(flashFairy2.getValue(1), 0xBEEF);
+}
+
+struct SimulatedInPlaceTraits : public InPlaceTraits {
+  using FlashHal = SimulatedFlashHal<>;
+
+  template <typename Key, typename Value, std::size_t NumIndexedKeys, std::size_t NumPages, std::size_t LinesPerPage>
+  using KeyIndex = PresenceHintIndex<Key, Value, NumIndexedKeys, NumPages, LinesPerPage>;
+};
+
+TEST(InPlace, Simulator_ReprogramsOnlyClearedBits) {
+  using SimulatedFlashFairy = BasicFlashFairyPP<SimulatedInPlaceTraits>;
+  alignas(8) uint8_t memory[2 * 1024];
+  FlashSimulator simulator(memory, 1024, 2);
+  simulator.setAllowReprogram(true);
+  SimulatedFlashHal<>::simulator = &simulator;
+
+  SimulatedFlashFairy::Config_t config;
+  config.pages[0] = reinterpret_cast<SimulatedFlashFairy::PagePtr_t>(simulator.page(0));
+  config.pages[1] = reinterpret_cast<SimulatedFlashFairy::PagePtr_t>(simulator.page(1));
+  SimulatedFlashFairy flashFairy;
+  flashFairy.initialize(config);
+
+  // 1000 events on a counter that is reset every 16 events.
+  for (unsigned event = 0; event < 1000; ++event) {
+    ASSERT_TRUE(flashFairy.setValue(11, thermometer(event % 16)));
+    ASSERT_EQ(flashFairy.getValue(11), thermometer(event % 16));
+  }
+  EXPECT_EQ(simulator.numFaults(), 0);
+  EXPECT_EQ(simulator.numErases(), 0);
+
+  SimulatedFlashFairy flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(11), thermometer(999 % 16));
+  SimulatedFlashHal<>::simulator = nullptr;
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,124 @@
+#include "FlashFairyPP/FlashFairyPP.h"
+#include "FlashFairyPP/KeyIndex.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+constexpr static const std::size_t kTestNumKeys = 64;
+constexpr static const std::size_t kTestNumPages = 4;
+constexpr static const std::size_t kTestLinesPerPage = 64;
+constexpr static const std::size_t kTestNumLines = kTestNumPages * kTestLinesPerPage;
+
+template <class Index>
+class KeyIndexFixture : public ::testing::Test {
+ public:
+  Index index;
+
+  // Simulated flash pages that back line hints.
+  uint16_t lines[kTestNumLines];
+
+  uint16_t readValueAt(std::size_t line) const { return lines[line]; }
+
+  void write(uint16_t key, uint16_t value, std::size_t line) {
+    lines[line] = value;
+    index.update(key, value, line);
+  }
+
+  bool find(uint16_t key, uint16_t& value) const {
+    return index.find(key, value, [this](std::size_t line) { return readValueAt(line); });
+  }
+
+  void SetUp() { index.clear(); }
+};
+
+using IndexTypes =
+    ::testing::Types<ValueCacheIndex<uint16_t, uint16_t, kTestNumKeys, kTestNumPages, kTestLinesPerPage>,
+                     PresenceHintIndex<uint16_t, uint16_t, kTestNumKeys, kTestNumPages, kTestLinesPerPage>>;
+TYPED_TEST_SUITE(KeyIndexFixture, IndexTypes);
+
+TYPED_TEST(KeyIndexFixture, Empty) {
+  uint16_t value = 1234;
+  for (uint16_t key = 0; key < kTestNumKeys; ++key) {
+    EXPECT_FALSE(this->find(key, value)) << "key: " << key;
+  }
+  EXPECT_EQ(value, 1234);
+}
+
+TYPED_TEST(KeyIndexFixture, NewestWins) {
+  this->write(3, 0xBEEF, 0);
+  this->write(5, 0xDEAD, 1);
+  this->write(3, 0xAFFE, 2);
+
+  uint16_t value = 0;
+  EXPECT_TRUE(this->find(3, value));
+  EXPECT_EQ(value, 0xAFFE);
+  EXPECT_TRUE(this->find(5, value));
+  EXPECT_EQ(value, 0xDEAD);
+  EXPECT_FALSE(this->find(4, value));
+}
+
+TYPED_TEST(KeyIndexFixture, AllPages) {
+  for (std::size_t page = 0; page < kTestNumPages; ++page) {
+    this->write(static_cast<uint16_t>(page), static_cast<uint16_t>(0x100 + page), page * kTestLinesPerPage + 7);
+  }
+  this->write(1, 0xBEEF, kTestNumLines - 1);
+  this->write(3, 0xAFFE, 2);
+
+  uint16_t value = 0;
+  EXPECT_TRUE(this->find(0, value));
+  EXPECT_EQ(value, 0x100);
+  EXPECT_TRUE(this->find(1, value));
+  EXPECT_EQ(value, 0xBEEF);
+  EXPECT_TRUE(this->find(2, value));
+  EXPECT_EQ(value, 0x102);
+  EXPECT_TRUE(this->find(3, value));
+  EXPECT_EQ(value, 0xAFFE);
+}
+
+TYPED_TEST(KeyIndexFixture, OutOfRange) {
+  this->write(kTestNumKeys, 0xBEEF, 0);
+  uint16_t value = 0;
+  EXPECT_FALSE(this->find(kTestNumKeys, value));
+  EXPECT_FALSE(this->find(0xFFFF, value));
+}
+
+TYPED_TEST(KeyIndexFixture, Clear) {
+  this->write(3, 0xBEEF, 255);
+  this->index.clear();
+  uint16_t value = 0;
+  EXPECT_FALSE(this->find(3, value));
+}
+
+TYPED_TEST(KeyIndexFixture, Remove) {
+  this->write(3, 0xBEEF, 0);
+  this->write(5, 0xDEAD, 1);
+  this->index.remove(3);
+  this->index.remove(kTestNumKeys);
+  uint16_t value = 0;
+  EXPECT_FALSE(this->find(3, value));
+  EXPECT_TRUE(this->find(5, value));
+  EXPECT_EQ(value, 0xDEAD);
+}
+
+TEST(KeyIndex, NoIndexIsEmpty) {
+  using Index = NoIndex<uint16_t, uint16_t, kTestNumKeys, kTestNumPages, kTestLinesPerPage>;
+  EXPECT_TRUE(std::is_empty<Index>::value);
+  EXPECT_FALSE(Index::kEnabled);
+}
+
+template <template <typename, typename, std::size_t, std::size_t, std::size_t> class Index>
+struct IndexTraits : public Traits<> {
+  template <typename Key, typename Value, std::size_t NumIndexedKeys, std::size_t NumPages, std::size_t LinesPerPage>
+  using KeyIndex = Index<Key, Value, NumIndexedKeys, NumPages, LinesPerPage>;
+};
+
+TEST(KeyIndex, PresenceHintIndexIsSmallerThanValueCache) {
+  // The indexes as the default store instantiates them: 256 keys, two pages of 256 lines.
+  using HintIndex = BasicFlashFairyPP<IndexTraits<PresenceHintIndex>>::KeyIndex_t;
+  using CacheIndex = BasicFlashFairyPP<IndexTraits<ValueCacheIndex>>::KeyIndex_t;
+  EXPECT_EQ(sizeof(CacheIndex), 544u);
+  EXPECT_EQ(sizeof(HintIndex), 320u);
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,101 @@
+#include <map>
+
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+/// The full 16 bit key space below the control keys, e.g., for a module ID in the upper byte.
+struct LargeKeySpaceTraits : public Traits<1024, 0xFFF0> {};
+using LargeKeySpace = BasicFlashFairyPP<LargeKeySpaceTraits>;
+
+struct LargeKeySpaceRingTraits : public LargeKeySpaceTraits {
+  constexpr static const std::size_t kNumPages = 3;
+};
+using LargeKeySpaceRing = BasicFlashFairyPP<LargeKeySpaceRingTraits>;
+
+static_assert(std::is_same<FlashFairyPP::KeySet_t, BitmapKeySet<uint16_t, 256, 2 * 253>>::value,
+              "Small key spaces use a bitmap");
+static_assert(std::is_same<LargeKeySpace::KeySet_t, SortedKeySet<uint16_t, 0xFFF0, 2 * 253>>::value,
+              "Large key spaces use a sorted array");
+static_assert(sizeof(LargeKeySpace::KeySet_t) < 1100, "The key set scales with the lines of the ring");
+
+TEST(KeySet, Sorted) {
+  SortedKeySet<uint16_t, 0xFFF0, 8> keySet;
+  EXPECT_EQ(keySet.size(), 0);
+  EXPECT_FALSE(keySet.contains(0x1234));
+
+  for (const uint16_t key : {0x1234, 0x0001, 0xFFEF, 0x0100, 0x1234, 0x0001}) {
+    keySet.insert(key);
+  }
+  EXPECT_EQ(keySet.size(), 4);
+  for (const uint16_t key : {0x0001, 0x0100, 0x1234, 0xFFEF}) {
+    EXPECT_TRUE(keySet.contains(key)) << key;
+    EXPECT_FALSE(keySet.insert(key)) << key;
+  }
+  EXPECT_FALSE(keySet.contains(0x0000));
+  EXPECT_FALSE(keySet.contains(0x0101));
+  EXPECT_TRUE(keySet.insert(0x0000));
+  EXPECT_EQ(keySet.size(), 5);
+}
+
+TEST(KeySet, Bitmap) {
+  BitmapKeySet<uint16_t, 256, 8> keySet;
+  EXPECT_TRUE(keySet.insert(255));
+  EXPECT_FALSE(keySet.insert(255));
+  EXPECT_TRUE(keySet.insert(0));
+  EXPECT_TRUE(keySet.contains(0));
+  EXPECT_FALSE(keySet.contains(1));
+  EXPECT_EQ(keySet.size(), 2);
+}
+
+template <class FlashFairyT>
+class LargeKeySpaceFixture : public BasicVirtualFlashFixture<FlashFairyT> {
+ public:
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  /// Sparse keys: a module ID in the upper byte and a setting in the lower byte.
+  static key_type makeKey(const std::size_t module, const std::size_t setting) {
+    return static_cast<key_type>((module << 8) | setting);
+  }
+};
+
+using LargeKeySpaceTypes = ::testing::Types<LargeKeySpace, LargeKeySpaceRing>;
+TYPED_TEST_SUITE(LargeKeySpaceFixture, LargeKeySpaceTypes);
+
+TYPED_TEST(LargeKeySpaceFixture, SparseKeys_Compaction) {
+  using key_type = typename TestFixture::key_type;
+  using value_type = typename TestFixture::value_type;
+  std::map<key_type, value_type> expected;
+
+  // Cold keys of many modules, then enough writes to hot keys to compact every page several times.
+  for (std::size_t module = 0; module < 0xFF; module += 5) {
+    const key_type key = this->makeKey(module, module % 7);
+    ASSERT_TRUE(this->flashFairy.setValue(key, static_cast<value_type>(module)));
+    expected[key] = static_cast<value_type>(module);
+  }
+  ASSERT_FALSE(this->flashFairy.setValue(static_cast<key_type>(TypeParam::kNumKeys), 0));
+  for (std::size_t i = 0; i < 2000; ++i) {
+    const key_type key = this->makeKey(0xFE, i % 16);
+    ASSERT_TRUE(this->flashFairy.setValue(key, static_cast<value_type>(i)));
+    expected[key] = static_cast<value_type>(i);
+  }
+  EXPECT_GT(eraseCounts.size(), 0);
+
+  EXPECT_EQ(this->flashFairy.countLiveKeys(), expected.size());
+  std::map<key_type, value_type> live;
+  for (const auto& entry : this->flashFairy.liveEntries()) {
+    EXPECT_TRUE(live.emplace(entry.first, entry.second).second) << entry.first;
+  }
+  EXPECT_EQ(live, expected);
+
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  for (const auto& entry : expected) {
+    EXPECT_EQ(flashFairy2.getValue(entry.first), entry.second) << entry.first;
+  }
+}
+
+}  // namespace FlashFairyPP
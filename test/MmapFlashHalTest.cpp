@@ -0,0 +1,157 @@
+#include <cstdlib>
+
+#include "FlashFairyPP/MmapFlashHal.h"
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+struct MmapTraits : public Traits<> {
+  using FlashHal = MmapFlashHal<>;
+};
+using MmapFlashFairy = BasicFlashFairyPP<MmapTraits>;
+
+class MmapFixture : public ::testing::Test {
+ public:
+  void SetUp() override {
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    ASSERT_TRUE(open());
+  }
+
+  void TearDown() override {
+    file.close();
+    MmapFlashHal<>::file = nullptr;
+    unlink(path);
+  }
+
+  bool open() {
+    if (!file.open(path, MmapFlashFairy::Config_t::pageSize, MmapFlashFairy::kNumPages)) {
+      return false;
+    }
+    MmapFlashHal<>::file = &file;
+    for (std::size_t i = 0; i < MmapFlashFairy::kNumPages; ++i) {
+      config.pages[i] = reinterpret_cast<MmapFlashFairy::PagePtr_t>(file.page(i));
+    }
+    flashFairy.initialize(config);
+    return true;
+  }
+
+  char path[32] = "/tmp/FlashFairyPPTest.XXXXXX";
+  MmapFlashFile file;
+  MmapFlashFairy::Config_t config;
+  MmapFlashFairy flashFairy;
+};
+
+TEST_F(MmapFixture, CreatesErasedFile) {
+  struct stat status;
+  ASSERT_EQ(stat(path, &status), 0);
+  EXPECT_EQ(static_cast<std::size_t>(status.st_size), 2 * MmapFlashFairy::Config_t::pageSize);
+  for (std::size_t i = 0; i < 2 * MmapFlashFairy::Config_t::pageSize; ++i) {
+    ASSERT_EQ(file.page(0)[i], 0xFF) << i;
+  }
+  EXPECT_EQ(flashFairy.getValue(1), MmapFlashFairy::npos);
+}
+
+TEST_F(MmapFixture, Reopen) {
+  for (std::size_t i = 0; i < 1000; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(static_cast<MmapFlashFairy::key_type>(i % 20), static_cast<uint16_t>(i)));
+  }
+  ASSERT_TRUE(flashFairy.setRecord(30, 1.5));
+  file.close();
+
+  ASSERT_TRUE(open());
+  for (std::size_t i = 1000 - 20; i < 1000; ++i) {
+    EXPECT_EQ(flashFairy.getValue(static_cast<MmapFlashFairy::key_type>(i % 20)), i);
+  }
+  double record = 0;
+  EXPECT_TRUE(flashFairy.getRecord(30, record));
+  EXPECT_EQ(record, 1.5);
+}
+
+TEST_F(MmapFixture, SyncsAtDurabilityPoints) {
+  const std::size_t numSyncs = file.numSyncs();
+  ASSERT_TRUE(flashFairy.setValue(1, 10));
+  EXPECT_EQ(file.numSyncs(), numSyncs + 1);
+  ASSERT_TRUE(flashFairy.setValue(1, 10));
+  EXPECT_EQ(file.numSyncs(), numSyncs + 1);
+
+  MmapFlashFairy::WriteBatch<4> batch;
+  batch.setValue(2, 20);
+  batch.setValue(3, 30);
+  ASSERT_TRUE(flashFairy.setValues(batch));
+  EXPECT_EQ(file.numSyncs(), numSyncs + 2);
+
+  // A page switch is durable before the value that caused it is written.
+  while (flashFairy.numEntriesLeftOnActivePage() > 0) {
+    ASSERT_TRUE(flashFairy.setValue(4, static_cast<uint16_t>(flashFairy.numEntriesLeftOnActivePage())));
+  }
+  const std::size_t numSyncsBeforeSwitch = file.numSyncs();
+  ASSERT_TRUE(flashFairy.setValue(4, 0xBEEF));
+  EXPECT_GE(file.numSyncs(), numSyncsBeforeSwitch + 2);
+  EXPECT_EQ(file.numSyncFailures(), 0);
+}
+
+TEST_F(MmapFixture, SizeMismatch) {
+  file.close();
+  MmapFlashFile largerFile;
+  EXPECT_FALSE(largerFile.open(path, MmapFlashFairy::Config_t::pageSize, 3));
+  EXPECT_EQ(largerFile.getLastError(), EINVAL);
+  EXPECT_FALSE(largerFile.isOpen());
+}
+
+TEST_F(MmapFixture, PrivateMappingKeepsFile) {
+  ASSERT_TRUE(flashFairy.setValue(1, 10));
+  file.close();
+
+  MmapFlashFile privateFile;
+  ASSERT_TRUE(privateFile.open(path, MmapFlashFairy::Config_t::pageSize, 0, MmapFlashFile::Access::kPrivate));
+  EXPECT_EQ(privateFile.numPages(), MmapFlashFairy::kNumPages);
+  MmapFlashHal<>::file = &privateFile;
+  for (std::size_t i = 0; i < MmapFlashFairy::kNumPages; ++i) {
+    config.pages[i] = reinterpret_cast<MmapFlashFairy::PagePtr_t>(privateFile.page(i));
+  }
+  MmapFlashFairy privateFlashFairy;
+  privateFlashFairy.initialize(config);
+  EXPECT_EQ(privateFlashFairy.getValue(1), 10);
+  EXPECT_TRUE(privateFlashFairy.setValue(1, 11));
+  EXPECT_TRUE(privateFlashFairy.formatFlash());
+  privateFile.close();
+
+  ASSERT_TRUE(open());
+  EXPECT_EQ(flashFairy.getValue(1), 10);
+
+  MmapFlashFile missingFile;
+  EXPECT_FALSE(missingFile.open("/tmp/FlashFairyPPTest.missing", 1024, 0, MmapFlashFile::Access::kPrivate));
+}
+
+TEST_F(VirtualFlashFixture, Mmap_SameLayoutAsFlash) {
+  char path[32] = "/tmp/FlashFairyPPTest.XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  MmapFlashFile file;
+  ASSERT_TRUE(file.open(path, MmapFlashFairy::Config_t::pageSize, MmapFlashFairy::kNumPages));
+  MmapFlashHal<>::file = &file;
+  MmapFlashFairy::Config_t mmapConfig;
+  for (std::size_t i = 0; i < MmapFlashFairy::kNumPages; ++i) {
+    mmapConfig.pages[i] = reinterpret_cast<MmapFlashFairy::PagePtr_t>(file.page(i));
+  }
+  MmapFlashFairy mmapFlashFairy;
+  mmapFlashFairy.initialize(mmapConfig);
+
+  for (std::size_t i = 0; i < 700; ++i) {
+    const FlashFairyPP::key_type key = static_cast<FlashFairyPP::key_type>((i * 7) % 40);
+    ASSERT_TRUE(flashFairy.setValue(key, static_cast<uint16_t>(i)));
+    ASSERT_TRUE(mmapFlashFairy.setValue(key, static_cast<uint16_t>(i)));
+  }
+  EXPECT_EQ(memcmp(pages, file.page(0), sizeof(pages)), 0);
+
+  file.close();
+  MmapFlashHal<>::file = nullptr;
+  unlink(path);
+}
+
+}  // namespace FlashFairyPP
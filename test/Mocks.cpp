@@ -2,8 +2,18 @@
 
 namespace FlashFairyPP {
 
-extern "C" void FlashFairy_Erase_Page(void* pagePtr) { memset(pagePtr, 0xFF, 1024); }
+std::map<const void*, std::size_t> eraseCounts;
+std::map<const void*, std::size_t> pageSizes;
+
+extern "C" void FlashFairy_Erase_Page(void* pagePtr) {
+  memset(pagePtr, 0xFF, pageSizes.at(pagePtr));
+  ++eraseCounts[pagePtr];
+}
 extern "C" void FlashFairy_Write_Word(void* pagePtr, uint32_t line) { *static_cast<uint32_t*>(pagePtr) = line; }
+extern "C" void FlashFairy_Write_DoubleWord(void* pagePtr, uint64_t line) {
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(pagePtr) % 8, 0u) << "Double-words must be aligned";
+  *static_cast<uint64_t*>(pagePtr) = line;
+}
 extern "C" void flash_lock() {}
 extern "C" void flash_unlock() {}
 
@@ -1,31 +1,44 @@
 #ifndef __MOCKS_H__
 #define __MOCKS_H__
 
+#include <map>
+
 #include "FlashFairyPP/FlashFairyPP.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace FlashFairyPP {
 
-class VirtualFlashFixture : public ::testing::Test {
+/// Number of times FlashFairy_Erase_Page was called for each page.
+extern std::map<const void*, std::size_t> eraseCounts;
+
+/// Size of each page that FlashFairy_Erase_Page may be called for.
+extern std::map<const void*, std::size_t> pageSizes;
+
+template <class FlashFairyT>
+class BasicVirtualFlashFixture : public ::testing::Test {
  public:
   void SetUp() {
+    eraseCounts.clear();
+    pageSizes.clear();
     memset(pages, 0xFF, sizeof(pages));
-    config.pages[0] = reinterpret_cast<uint32_t*>(&pages[0]);
-    config.pages[1] = reinterpret_cast<uint32_t*>(&pages[1]);
+    for (std::size_t i = 0; i < FlashFairyT::kNumPages; ++i) {
+      config.pages[i] = reinterpret_cast<typename FlashFairyT::PagePtr_t>(&pages[i]);
+      pageSizes[&pages[i]] = FlashFairyT::Config_t::pageSize;
+    }
     flashFairy.initialize(config);
   }
 
   void TearDown() {}
 
-  using PageType = uint8_t[1024];
+  using PageType = uint8_t[FlashFairyT::Config_t::pageSize];
 
-  PageType pages[2];
-  FlashFairyPP::Config_t config;
+  alignas(8) PageType pages[FlashFairyT::kNumPages];
+  typename FlashFairyT::Config_t config;
 
-  FlashFairyPP flashFairy;
+  FlashFairyT flashFairy;
 
-  static void pageIsEmpty(uint8_t* page) { memoryIsEmpty(page, FlashFairyPP::Config_t::pageSize); }
+  static void pageIsEmpty(uint8_t* page) { memoryIsEmpty(page, FlashFairyT::Config_t::pageSize); }
 
   static void memoryIsEmpty(uint8_t* page, std::size_t len) {
     for (std::size_t i = 0; i < len; ++i) {
@@ -34,6 +47,8 @@ class VirtualFlashFixture : public ::testing::Test {
   }
 };
 
+using VirtualFlashFixture = BasicVirtualFlashFixture<FlashFairyPP>;
+
 class VisitorMock {
  public:
   MOCK_METHOD(void, BracketOperator, (int, int), ());
@@ -0,0 +1,177 @@
+#include "FlashFairyPP/PartitionedFlashFairyPP.h"
+#include "FlashFairyPP/WriteBackBuffer.h"
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+struct PartitionTraits : public Traits<> {
+  template <std::size_t NumPages>
+  using Statistics = ::FlashFairyPP::Statistics<NumPages>;
+};
+
+/// A single store on as many pages as both partitions together.
+struct UnpartitionedTraits : public PartitionTraits {
+  constexpr static const std::size_t kNumPages = 4;
+};
+
+constexpr const std::size_t kNumHotKeys = 8;
+using HotKeys = KeyRange<0, kNumHotKeys>;
+using Partitioned = PartitionedFlashFairyPP<PartitionTraits, PartitionTraits, HotKeys>;
+using Unpartitioned = BasicFlashFairyPP<UnpartitionedTraits>;
+
+static_assert(Partitioned::isHotKey(0) && Partitioned::isHotKey(7) && !Partitioned::isHotKey(8),
+              "Keys are routed at compile time");
+
+class PartitionFixture : public ::testing::Test {
+ public:
+  constexpr static const std::size_t kPageSize = Partitioned::Hot_t::Config_t::pageSize;
+  constexpr static const std::size_t kNumPagesPerPartition = Partitioned::Hot_t::kNumPages;
+
+  void SetUp() override {
+    eraseCounts.clear();
+    pageSizes.clear();
+    memset(hotPages, 0xFF, sizeof(hotPages));
+    memset(coldPages, 0xFF, sizeof(coldPages));
+    for (std::size_t i = 0; i < kNumPagesPerPartition; ++i) {
+      config.hot.pages[i] = reinterpret_cast<Partitioned::Hot_t::PagePtr_t>(&hotPages[i]);
+      config.cold.pages[i] = reinterpret_cast<Partitioned::Cold_t::PagePtr_t>(&coldPages[i]);
+      pageSizes[&hotPages[i]] = kPageSize;
+      pageSizes[&coldPages[i]] = kPageSize;
+    }
+    flashFairy.initialize(config);
+  }
+
+  static bool isErased(const uint8_t* page) {
+    for (std::size_t i = 0; i < kPageSize; ++i) {
+      if (page[i] != 0xFF) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  alignas(8) uint8_t hotPages[kNumPagesPerPartition][kPageSize];
+  alignas(8) uint8_t coldPages[kNumPagesPerPartition][kPageSize];
+  Partitioned::Config_t config;
+  Partitioned flashFairy;
+};
+
+TEST_F(PartitionFixture, RoutesKeys) {
+  EXPECT_TRUE(flashFairy.setValue(1, 10));
+  EXPECT_FALSE(isErased(hotPages[0]));
+  EXPECT_TRUE(isErased(coldPages[0]));
+
+  EXPECT_TRUE(flashFairy.setValue(100, 1000));
+  EXPECT_FALSE(isErased(coldPages[0]));
+  EXPECT_EQ(flashFairy.hot().countLiveKeys(), 1);
+  EXPECT_EQ(flashFairy.cold().countLiveKeys(), 1);
+
+  EXPECT_EQ(flashFairy.getValue(1), 10);
+  EXPECT_EQ(flashFairy.getValue(100), 1000);
+  EXPECT_EQ(flashFairy.getValue(2), Partitioned::npos);
+  EXPECT_EQ(flashFairy.getValue(101), Partitioned::npos);
+  int value = 0;
+  EXPECT_TRUE(flashFairy.readValueIfAvailable(100, value));
+  EXPECT_EQ(value, 1000);
+  EXPECT_FALSE(flashFairy.setValue(Partitioned::kNumKeys, 1));
+
+  // Lookups only scan the partition of their key.
+  const uint32_t coldScanned = flashFairy.cold().getStatistics().numScannedLines;
+  EXPECT_EQ(flashFairy.getValue(3), Partitioned::npos);
+  EXPECT_EQ(flashFairy.cold().getStatistics().numScannedLines, coldScanned);
+
+  Partitioned flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(1), 10);
+  EXPECT_EQ(flashFairy2.getValue(100), 1000);
+  EXPECT_EQ(flashFairy2.countLiveKeys(), 2);
+}
+
+TEST_F(PartitionFixture, BatchesAndRecords) {
+  // A batch that spans both partitions could not be committed as a whole.
+  Partitioned::WriteBatch<4> batch;
+  batch.setValue(1, 11);
+  batch.setValue(50, 500);
+  batch.setValue(2, 22);
+  EXPECT_FALSE(flashFairy.setValues(batch));
+  EXPECT_EQ(flashFairy.countLiveKeys(), 0);
+  EXPECT_TRUE(isErased(hotPages[0]));
+  EXPECT_TRUE(isErased(coldPages[0]));
+
+  Partitioned::WriteBatch<4> hotBatch;
+  hotBatch.setValue(1, 11);
+  hotBatch.setValue(2, 22);
+  EXPECT_TRUE(flashFairy.setValues(hotBatch));
+  Partitioned::WriteBatch<4> coldBatch;
+  coldBatch.setValue(50, 500);
+  EXPECT_TRUE(flashFairy.setValues(coldBatch));
+  EXPECT_EQ(flashFairy.hot().countLiveKeys(), 2);
+  EXPECT_EQ(flashFairy.cold().countLiveKeys(), 1);
+
+  EXPECT_TRUE(flashFairy.setRecord(60, uint32_t(0xDEADBEEF)));
+  uint32_t record = 0;
+  EXPECT_TRUE(flashFairy.getRecord(60, record));
+  EXPECT_EQ(record, 0xDEADBEEF);
+  EXPECT_EQ(flashFairy.cold().countLiveKeys(), 2);
+
+  Partitioned::value_type values[Partitioned::kNumKeys];
+  Partitioned::KeyBitmap_t present;
+  EXPECT_EQ(flashFairy.loadValues(values, present), 3);
+  EXPECT_TRUE(present.isSet(1) && present.isSet(2) && present.isSet(50));
+  EXPECT_FALSE(present.isSet(60));
+  EXPECT_EQ(values[1], 11);
+  EXPECT_EQ(values[2], 22);
+  EXPECT_EQ(values[50], 500);
+
+  // A write-back buffer in front of the partitioned store flushes a batch, so it buffers the keys of one partition.
+  WriteBackBuffer<Partitioned, 4> buffer(flashFairy);
+  EXPECT_TRUE(buffer.setValue(51, 510));
+  EXPECT_TRUE(buffer.setValue(52, 520));
+  EXPECT_TRUE(buffer.flush());
+  EXPECT_EQ(flashFairy.getValue(51), 510);
+  EXPECT_EQ(flashFairy.getValue(52), 520);
+}
+
+TEST_F(PartitionFixture, HotChurnOnlyCopiesHotKeys) {
+  constexpr static const std::size_t kNumColdKeys = 200;
+  constexpr static const std::size_t kNumHotWrites = 5000;
+  alignas(8) static uint8_t pages[Unpartitioned::kNumPages][kPageSize];
+  memset(pages, 0xFF, sizeof(pages));
+  Unpartitioned::Config_t unpartitionedConfig;
+  for (std::size_t i = 0; i < Unpartitioned::kNumPages; ++i) {
+    unpartitionedConfig.pages[i] = reinterpret_cast<Unpartitioned::PagePtr_t>(&pages[i]);
+    pageSizes[&pages[i]] = kPageSize;
+  }
+  Unpartitioned unpartitioned;
+  unpartitioned.initialize(unpartitionedConfig);
+
+  for (std::size_t key = kNumHotKeys; key < kNumHotKeys + kNumColdKeys; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+    ASSERT_TRUE(unpartitioned.setValue(key, key));
+  }
+  for (std::size_t i = 0; i < kNumHotWrites; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % kNumHotKeys, i));
+    ASSERT_TRUE(unpartitioned.setValue(i % kNumHotKeys, i));
+  }
+
+  const auto& hotStatistics = flashFairy.hot().getStatistics();
+  const auto& coldStatistics = flashFairy.cold().getStatistics();
+  const auto& unpartitionedStatistics = unpartitioned.getStatistics();
+  EXPECT_EQ(coldStatistics.numCompactions, 0);
+  EXPECT_GT(hotStatistics.numCompactions, 10);
+  // Every compaction of the unpartitioned store copies cold keys, the hot partition only copies hot keys.
+  EXPECT_LE(hotStatistics.numCopiedLines, hotStatistics.numCompactions * kNumHotKeys);
+  EXPECT_GT(unpartitionedStatistics.numCopiedLines, 10 * hotStatistics.numCopiedLines);
+  EXPECT_GT(unpartitionedStatistics.numErases, hotStatistics.numErases);
+
+  for (std::size_t key = kNumHotKeys; key < kNumHotKeys + kNumColdKeys; ++key) {
+    EXPECT_EQ(flashFairy.getValue(key), key);
+  }
+  for (std::size_t key = 0; key < kNumHotKeys; ++key) {
+    EXPECT_EQ(flashFairy.getValue(key), unpartitioned.getValue(key));
+  }
+}
+
+}  // namespace FlashFairyPP
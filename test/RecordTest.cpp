@@ -0,0 +1,204 @@
+#include <cstring>
+
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+constexpr static const std::size_t kDataLines = 256 - FlashFairyPP::kPageHeaderLines;
+
+struct Calibration {
+  char name[16];
+  float offset;
+  float gain;
+};
+
+static Calibration makeCalibration(const char* name, float offset, float gain) {
+  Calibration calibration;
+  memset(&calibration, 0, sizeof(calibration));
+  strncpy(calibration.name, name, sizeof(calibration.name) - 1);
+  calibration.offset = offset;
+  calibration.gain = gain;
+  return calibration;
+}
+
+static bool operator==(const Calibration& lhs, const Calibration& rhs) {
+  return memcmp(&lhs, &rhs, sizeof(Calibration)) == 0;
+}
+
+TEST_F(VirtualFlashFixture, Record_Float) {
+  EXPECT_TRUE(FlashFairyPP::kRecordsSupported);
+  EXPECT_TRUE(flashFairy.setRecord(7, 3.5f));
+
+  float value = 0.0f;
+  EXPECT_TRUE(flashFairy.getRecord(7, value));
+  EXPECT_EQ(value, 3.5f);
+
+  // Two payload lines followed by the trailer.
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 3);
+  uint32_t* lines = reinterpret_cast<uint32_t*>(pages[0]) + FlashFairyPP::kPageHeaderLines;
+  EXPECT_EQ(lines[0], 0x80600000);
+  EXPECT_EQ(lines[1], 0x81000040);
+  EXPECT_EQ(lines[2], 0xC0070004);
+
+  // Records are neither values nor visited as values.
+  EXPECT_EQ(flashFairy.getValue(7), FlashFairyPP::npos);
+  ::testing::StrictMock<VisitorMock> v;
+  flashFairy.visitEntries(v);
+}
+
+TEST_F(VirtualFlashFixture, Record_Twice) {
+  const Calibration calibration = makeCalibration("sensor", 1.5f, -2.0f);
+  EXPECT_TRUE(flashFairy.setRecord(3, calibration));
+  const std::size_t entriesLeft = flashFairy.numEntriesLeftOnActivePage();
+  EXPECT_EQ(entriesLeft, kDataLines - 8 - 1);
+
+  EXPECT_TRUE(flashFairy.setRecord(3, calibration));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), entriesLeft);
+
+  const Calibration changed = makeCalibration("sensor", 1.5f, -2.5f);
+  EXPECT_TRUE(flashFairy.setRecord(3, changed));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), entriesLeft - 9);
+
+  Calibration readBack;
+  EXPECT_TRUE(flashFairy.getRecord(3, readBack));
+  EXPECT_TRUE(readBack == changed);
+}
+
+TEST_F(VirtualFlashFixture, Record_Reset_Load) {
+  const Calibration calibration = makeCalibration("thermocouple", 0.25f, 1.125f);
+  EXPECT_TRUE(flashFairy.setValue(1, 0xBEEF));
+  EXPECT_TRUE(flashFairy.setRecord(2, calibration));
+  EXPECT_TRUE(flashFairy.setValue(3, 0xDEAD));
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  Calibration readBack;
+  EXPECT_TRUE(flashFairy2.getRecord(2, readBack));
+  EXPECT_TRUE(readBack == calibration);
+  EXPECT_EQ(flashFairy2.getValue(1), 0xBEEF);
+  EXPECT_EQ(flashFairy2.getValue(3), 0xDEAD);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 2 - 9);
+}
+
+TEST_F(VirtualFlashFixture, Record_ReplacesValue) {
+  EXPECT_TRUE(flashFairy.setValue(5, 0xBEEF));
+  EXPECT_TRUE(flashFairy.setRecord(5, uint32_t(0x12345678)));
+  EXPECT_EQ(flashFairy.getValue(5), FlashFairyPP::npos);
+
+  FlashFairyPP::value_type value = 0;
+  EXPECT_FALSE(flashFairy.readValueIfAvailable(5, value));
+
+  EXPECT_TRUE(flashFairy.setValue(5, 0xBEEF));
+  EXPECT_EQ(flashFairy.getValue(5), 0xBEEF);
+  uint32_t record = 0;
+  EXPECT_FALSE(flashFairy.getRecord(5, record));
+
+  // The index sees the same history after a remount.
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(5), 0xBEEF);
+  EXPECT_TRUE(flashFairy2.setRecord(5, uint32_t(0x12345678)));
+  EXPECT_EQ(flashFairy2.getValue(5), FlashFairyPP::npos);
+
+  FlashFairyPP flashFairy3;
+  flashFairy3.initialize(config);
+  EXPECT_EQ(flashFairy3.getValue(5), FlashFairyPP::npos);
+  EXPECT_TRUE(flashFairy3.getRecord(5, record));
+  EXPECT_EQ(record, 0x12345678);
+}
+
+TEST_F(VirtualFlashFixture, Record_Sizes) {
+  uint8_t buffer[FlashFairyPP::kMaxRecordSize + 1];
+  for (std::size_t i = 0; i < sizeof(buffer); ++i) {
+    buffer[i] = static_cast<uint8_t>(i * 7);
+  }
+  EXPECT_FALSE(flashFairy.setRecord(1, buffer, sizeof(buffer)));
+  EXPECT_FALSE(flashFairy.setRecord(FlashFairyPP::kNumKeys, buffer, 4));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines);
+
+  EXPECT_TRUE(flashFairy.setRecord(1, buffer, FlashFairyPP::kMaxRecordSize));
+  EXPECT_TRUE(flashFairy.setRecord(2, buffer, 0));
+
+  uint8_t readBack[FlashFairyPP::kMaxRecordSize] = {};
+  std::size_t recordSize = 0;
+  EXPECT_TRUE(flashFairy.getRecord(1, readBack, sizeof(readBack), &recordSize));
+  EXPECT_EQ(recordSize, FlashFairyPP::kMaxRecordSize);
+  EXPECT_EQ(memcmp(readBack, buffer, recordSize), 0);
+
+  EXPECT_TRUE(flashFairy.getRecord(2, readBack, sizeof(readBack), &recordSize));
+  EXPECT_EQ(recordSize, 0);
+
+  // Short buffers receive a prefix of the record, typed reads need the exact size.
+  uint8_t prefix[5] = {};
+  EXPECT_TRUE(flashFairy.getRecord(1, prefix, sizeof(prefix), &recordSize));
+  EXPECT_EQ(recordSize, FlashFairyPP::kMaxRecordSize);
+  EXPECT_EQ(memcmp(prefix, buffer, sizeof(prefix)), 0);
+  uint64_t value = 0;
+  EXPECT_FALSE(flashFairy.getRecord(1, value));
+  EXPECT_FALSE(flashFairy.getRecord(3, value));
+}
+
+TEST_F(VirtualFlashFixture, Record_Compaction) {
+  const Calibration calibration = makeCalibration("pressure", 3.0f, 0.5f);
+  EXPECT_TRUE(flashFairy.setRecord(9, calibration));
+
+  // Overwrite a hot key until the record got copied several times.
+  for (std::size_t i = 0; i < 4 * FlashFairyPP::kNumPages * 256; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(1, i));
+  }
+
+  Calibration readBack;
+  EXPECT_TRUE(flashFairy.getRecord(9, readBack));
+  EXPECT_TRUE(readBack == calibration);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_TRUE(flashFairy2.getRecord(9, readBack));
+  EXPECT_TRUE(readBack == calibration);
+}
+
+TEST_F(VirtualFlashFixture, Record_DoesNotStraddlePages) {
+  for (std::size_t i = 0; i < kDataLines - 6; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(i % 10, i));
+  }
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 6);
+
+  const Calibration calibration = makeCalibration("flow", 1.0f, 2.0f);
+  EXPECT_TRUE(flashFairy.setRecord(20, calibration));
+  pageIsEmpty(pages[0]);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 10 - 9);
+
+  Calibration readBack;
+  EXPECT_TRUE(flashFairy.getRecord(20, readBack));
+  EXPECT_TRUE(readBack == calibration);
+}
+
+TEST_F(VirtualFlashFixture, Record_PowerLossBeforeTrailer) {
+  const Calibration calibration = makeCalibration("old", 1.0f, 1.0f);
+  const Calibration changed = makeCalibration("new", 2.0f, 2.0f);
+  EXPECT_TRUE(flashFairy.setRecord(4, calibration));
+  EXPECT_TRUE(flashFairy.setRecord(4, changed));
+
+  // Simulate a power loss after the payload of the second record, but before its trailer.
+  memset(pages[0] + (FlashFairyPP::kPageHeaderLines + 17) * 4, 0xFF, 4);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  Calibration readBack;
+  EXPECT_TRUE(flashFairy2.getRecord(4, readBack));
+  EXPECT_TRUE(readBack == calibration);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), kDataLines - 17);
+
+  // Orphaned payload is skipped by every reader, including compaction.
+  ::testing::StrictMock<VisitorMock> v;
+  flashFairy2.visitEntries(v);
+  for (std::size_t i = 0; i < 2 * 256; ++i) {
+    ASSERT_TRUE(flashFairy2.setValue(1, i));
+  }
+  EXPECT_TRUE(flashFairy2.getRecord(4, readBack));
+  EXPECT_TRUE(readBack == calibration);
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,100 @@
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+constexpr static const std::size_t kLinesPerPage =
+    FlashFairyPP::Config_t::pageSize / sizeof(FlashFairyPP::FlashLine_t) - FlashFairyPP::kPageHeaderLines;
+
+TEST_F(VirtualFlashFixture, Ring_FillsPagesInOrder) {
+  constexpr static const std::size_t kNumHotKeys = 10;
+
+  for (std::size_t page = 0; page + 1 < FlashFairyPP::kNumPages; ++page) {
+    for (std::size_t i = 0; i < kLinesPerPage; ++i) {
+      ASSERT_TRUE(flashFairy.setValue((page * kLinesPerPage + i) % kNumHotKeys, page * kLinesPerPage + i));
+    }
+    // No page was erased so far, all pages after the current one are still untouched.
+    if (page > 0) {
+      // The previous page was closed with its number of data lines.
+      const FlashFairyPP::FlashLine_t* header = reinterpret_cast<const FlashFairyPP::FlashLine_t*>(pages[page - 1]);
+      EXPECT_EQ(header[2], 0xFFF80000 | kLinesPerPage);
+    }
+    EXPECT_TRUE(eraseCounts.empty());
+    for (std::size_t emptyPage = page + 1; emptyPage < FlashFairyPP::kNumPages; ++emptyPage) {
+      pageIsEmpty(pages[emptyPage]);
+    }
+  }
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), 0);
+
+  // Entering the last page reclaims the oldest one.
+  ASSERT_TRUE(flashFairy.setValue(0, 0xBEEF));
+  pageIsEmpty(pages[0]);
+  EXPECT_EQ(eraseCounts.size(), 1);
+  EXPECT_EQ(eraseCounts[pages[0]], 1);
+
+  // Only keys whose newest value lived on the oldest page were copied.
+  const std::size_t numCopied = (FlashFairyPP::kNumPages == 2) ? kNumHotKeys - 1 : 0;
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kLinesPerPage - 1 - numCopied);
+
+  const std::size_t numWrites = (FlashFairyPP::kNumPages - 1) * kLinesPerPage;
+  EXPECT_EQ(flashFairy.getValue(0), 0xBEEF);
+  for (std::size_t key = 1; key < kNumHotKeys; ++key) {
+    std::size_t newestWrite = numWrites - 1;
+    while (newestWrite % kNumHotKeys != key) {
+      --newestWrite;
+    }
+    EXPECT_EQ(flashFairy.getValue(key), newestWrite) << "key: " << key;
+  }
+}
+
+TEST_F(VirtualFlashFixture, Ring_SpreadsErases) {
+  // A few cold keys and one hot key.
+  for (FlashFairyPP::key_type key = 0; key < 20; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  for (std::size_t i = 0; i < 20 * FlashFairyPP::kNumPages * kLinesPerPage; ++i) {
+    ASSERT_TRUE(flashFairy.setValue(100, i));
+  }
+
+  std::size_t minErases = eraseCounts[pages[0]];
+  std::size_t maxErases = minErases;
+  for (std::size_t page = 0; page < FlashFairyPP::kNumPages; ++page) {
+    minErases = std::min(minErases, eraseCounts[pages[page]]);
+    maxErases = std::max(maxErases, eraseCounts[pages[page]]);
+  }
+  EXPECT_GT(minErases, 0);
+  EXPECT_LE(maxErases - minErases, 1);
+
+  for (FlashFairyPP::key_type key = 0; key < 20; ++key) {
+    EXPECT_EQ(flashFairy.getValue(key), key);
+  }
+  EXPECT_EQ(flashFairy.getValue(100), 20 * FlashFairyPP::kNumPages * kLinesPerPage - 1);
+}
+
+TEST_F(VirtualFlashFixture, Ring_Reset_Load) {
+  FlashFairyPP::value_type expected[64];
+  for (std::size_t i = 0; i < 7 * kLinesPerPage + 13; ++i) {
+    const FlashFairyPP::key_type key = static_cast<FlashFairyPP::key_type>((i * 7) % 64);
+    const FlashFairyPP::value_type value = static_cast<FlashFairyPP::value_type>(i);
+    ASSERT_TRUE(flashFairy.setValue(key, value));
+    expected[key] = value;
+
+    if (i % 97 == 0) {
+      FlashFairyPP flashFairy2;
+      flashFairy2.initialize(config);
+      ASSERT_EQ(flashFairy2.numEntriesLeftOnActivePage(), flashFairy.numEntriesLeftOnActivePage()) << "i: " << i;
+      for (FlashFairyPP::key_type readKey = 0; readKey < 64; ++readKey) {
+        ASSERT_EQ(flashFairy2.getValue(readKey), flashFairy.getValue(readKey)) << "i: " << i;
+      }
+    }
+  }
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  for (FlashFairyPP::key_type key = 0; key < 64; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(key), expected[key]);
+  }
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,113 @@
+#include <cstring>
+
+#include "FlashFairyPP/Schema.h"
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+enum class DisplayMode : uint8_t { kOff, kDim, kBright };
+
+struct SensorGains {
+  float gains[4];
+};
+
+struct Brightness : Setting<1, uint8_t, 128> {};
+struct Offset : Setting<2, int16_t, -5> {};
+struct Trim : Setting<3, int8_t> {};
+struct Mode : Setting<4, DisplayMode, DisplayMode::kDim> {};
+struct Enabled : Setting<5, bool, true> {};
+struct Serial : Setting<6, uint32_t, 0x12345678> {};
+struct Gains : RecordSetting<7, SensorGains> {
+  static SensorGains defaultValue() { return SensorGains{{1.0f, 1.0f, 1.0f, 1.0f}}; }
+};
+struct Unused : Setting<8, uint8_t> {};
+struct SameKeyAsBrightness : Setting<1, uint16_t> {};
+struct OutOfRange : Setting<FlashFairyPP::kNumKeys, uint8_t> {};
+
+using AppSettings = Schema<FlashFairyPP, Brightness, Offset, Trim, Mode, Enabled, Serial, Gains>;
+
+static_assert(AppSettings::kNumSettings == 7, "All settings are part of the schema");
+static_assert(AppSettings::contains<Brightness>() && !AppSettings::contains<Unused>(), "Membership is static");
+static_assert(AppSettings::hasDistinctKeys() && AppSettings::hasKeysInRange() && AppSettings::hasStorableTypes(),
+              "Schema is valid");
+static_assert(!Schema<FlashFairyPP, Brightness, Offset, SameKeyAsBrightness>::hasDistinctKeys(),
+              "Duplicate keys are detected");
+static_assert(!Schema<FlashFairyPP, Brightness, OutOfRange>::hasKeysInRange(), "Keys beyond kNumKeys are detected");
+static_assert(AppSettings::isStoredAsValue<Brightness>() && AppSettings::isStoredAsValue<Offset>() &&
+                  AppSettings::isStoredAsValue<Mode>() && AppSettings::isStoredAsValue<Enabled>(),
+              "Settings that fit into a value line are stored as values");
+static_assert(!AppSettings::isStoredAsValue<Serial>() && !AppSettings::isStoredAsValue<Gains>(),
+              "Wider settings are stored as records");
+static_assert(AppSettings::defaultValue<Brightness>() == 128 && AppSettings::defaultValue<Offset>() == -5,
+              "Defaults are known at compile time");
+
+class SchemaFixture : public VirtualFlashFixture {
+ public:
+  SchemaFixture() : settings(flashFairy) {}
+
+  AppSettings settings;
+};
+
+TEST_F(SchemaFixture, Defaults) {
+  EXPECT_EQ(settings.get<Brightness>(), 128);
+  EXPECT_EQ(settings.get<Offset>(), -5);
+  EXPECT_EQ(settings.get<Trim>(), 0);
+  EXPECT_EQ(settings.get<Mode>(), DisplayMode::kDim);
+  EXPECT_TRUE(settings.get<Enabled>());
+  EXPECT_EQ(settings.get<Serial>(), 0x12345678u);
+  EXPECT_EQ(settings.get<Gains>().gains[3], 1.0f);
+
+  uint8_t brightness = 7;
+  EXPECT_FALSE(settings.find<Brightness>(brightness));
+  EXPECT_EQ(brightness, 7);
+  // Defaults are not written to flash.
+  pageIsEmpty(pages[0]);
+  pageIsEmpty(pages[1]);
+}
+
+TEST_F(SchemaFixture, SetAndGet) {
+  EXPECT_TRUE(settings.set<Brightness>(200));
+  EXPECT_TRUE(settings.set<Offset>(-300));
+  EXPECT_TRUE(settings.set<Trim>(-2));
+  EXPECT_TRUE(settings.set<Mode>(DisplayMode::kBright));
+  EXPECT_TRUE(settings.set<Enabled>(false));
+  EXPECT_TRUE(settings.set<Serial>(0xDEADBEEF));
+  EXPECT_TRUE(settings.set<Gains>(SensorGains{{0.5f, 2.0f, 3.0f, 4.0f}}));
+
+  // Values are stored as their unsigned representation.
+  EXPECT_EQ(flashFairy.getValue(Brightness::kKey), 200);
+  EXPECT_EQ(flashFairy.getValue(Offset::kKey), static_cast<uint16_t>(-300));
+  EXPECT_EQ(flashFairy.getValue(Trim::kKey), 0xFE);
+  EXPECT_EQ(flashFairy.getValue(Mode::kKey), 2);
+  EXPECT_EQ(flashFairy.getValue(Enabled::kKey), 0);
+  uint32_t serial = 0;
+  EXPECT_TRUE(flashFairy.getRecord(Serial::kKey, serial));
+  EXPECT_EQ(serial, 0xDEADBEEF);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  const AppSettings settings2(flashFairy2);
+  EXPECT_EQ(settings2.get<Brightness>(), 200);
+  EXPECT_EQ(settings2.get<Offset>(), -300);
+  EXPECT_EQ(settings2.get<Trim>(), -2);
+  EXPECT_EQ(settings2.get<Mode>(), DisplayMode::kBright);
+  EXPECT_FALSE(settings2.get<Enabled>());
+  EXPECT_EQ(settings2.get<Serial>(), 0xDEADBEEF);
+  EXPECT_EQ(settings2.get<Gains>().gains[0], 0.5f);
+  EXPECT_EQ(settings2.get<Gains>().gains[3], 4.0f);
+}
+
+TEST_F(SchemaFixture, MismatchedEntryReadsDefault) {
+  // A record setting whose key holds a value, or a record of another size, e.g., from an older firmware.
+  EXPECT_TRUE(flashFairy.setValue(Gains::kKey, 1));
+  EXPECT_EQ(settings.get<Gains>().gains[0], 1.0f);
+  EXPECT_TRUE(flashFairy.setRecord(Gains::kKey, 2.0f));
+  EXPECT_EQ(settings.get<Gains>().gains[0], 1.0f);
+
+  EXPECT_TRUE(flashFairy.setRecord(Brightness::kKey, 2.0f));
+  EXPECT_EQ(settings.get<Brightness>(), 128);
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <vector>
+
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+/// Records the trace hooks as a sequence of events.
+struct RecordingTrace {
+  enum class Event { kErase, kProgram, kCompactionBegin, kCompactionEnd };
+
+  static std::vector<Event> events;
+  static std::size_t numProgrammedLines;
+
+  static void onErase(const void*) { events.push_back(Event::kErase); }
+  static void onProgram(const void*, const std::size_t numLines) {
+    events.push_back(Event::kProgram);
+    numProgrammedLines += numLines;
+  }
+  static void onCompactionBegin(const void*) { events.push_back(Event::kCompactionBegin); }
+  static void onCompactionEnd(const void*) { events.push_back(Event::kCompactionEnd); }
+};
+
+std::vector<RecordingTrace::Event> RecordingTrace::events;
+std::size_t RecordingTrace::numProgrammedLines = 0;
+
+struct StatisticsTraits : public Traits<> {
+  template <std::size_t NumPages>
+  using Statistics = ::FlashFairyPP::Statistics<NumPages>;
+  using Trace = RecordingTrace;
+};
+
+using CountingFlashFairy = BasicFlashFairyPP<StatisticsTraits>;
+
+class StatisticsFixture : public BasicVirtualFlashFixture<CountingFlashFairy> {
+ public:
+  void SetUp() override {
+    RecordingTrace::events.clear();
+    RecordingTrace::numProgrammedLines = 0;
+    BasicVirtualFlashFixture<CountingFlashFairy>::SetUp();
+  }
+
+  const CountingFlashFairy::Statistics_t& statistics() const { return flashFairy.getStatistics(); }
+};
+
+TEST(Statistics, DisabledByDefault) {
+  EXPECT_FALSE(FlashFairyPP::Statistics_t::kEnabled);
+  EXPECT_TRUE(std::is_empty<FlashFairyPP::Statistics_t>::value);
+  EXPECT_TRUE((std::is_same<FlashFairyPP::Trace_t, NoTrace>::value));
+}
+
+TEST_F(StatisticsFixture, Writes) {
+  EXPECT_TRUE(flashFairy.setValue(1, 10));
+  EXPECT_TRUE(flashFairy.setValue(2, 20));
+  EXPECT_TRUE(flashFairy.setValue(1, 10));
+  EXPECT_TRUE(flashFairy.setValue(1, 11));
+
+  EXPECT_EQ(statistics().numWrites, 3);
+  EXPECT_EQ(statistics().numSkippedWrites, 1);
+  EXPECT_EQ(statistics().numUserLines, 3);
+  // The page header of the first page adds two lines.
+  EXPECT_EQ(statistics().numProgrammedLines, 5);
+  EXPECT_FLOAT_EQ(statistics().writeAmplification(), 5.0f / 3.0f);
+  EXPECT_EQ(RecordingTrace::numProgrammedLines, 5);
+  EXPECT_EQ(flashFairy.countLiveKeys(), 2);
+
+  CountingFlashFairy::WriteBatch<4> batch;
+  batch.setValue(1, 11);
+  batch.setValue(3, 30);
+  batch.setValue(4, 40);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+  EXPECT_EQ(statistics().numWrites, 4);
+  EXPECT_EQ(statistics().numUserLines, 5);
+  // Begin and commit markers.
+  EXPECT_EQ(statistics().numProgrammedLines, 5 + 4);
+  EXPECT_TRUE(flashFairy.setValues(batch));
+  EXPECT_EQ(statistics().numSkippedWrites, 2);
+
+  EXPECT_TRUE(flashFairy.setRecord(5, uint32_t(0x12345678)));
+  EXPECT_TRUE(flashFairy.setRecord(5, uint32_t(0x12345678)));
+  EXPECT_EQ(statistics().numWrites, 5);
+  EXPECT_EQ(statistics().numSkippedWrites, 3);
+  EXPECT_EQ(statistics().numUserLines, 5 + 3);
+  EXPECT_EQ(flashFairy.countLiveKeys(), 5);
+}
+
+TEST_F(StatisticsFixture, Compaction) {
+  constexpr static const std::size_t kNumColdKeys = 20;
+  for (CountingFlashFairy::key_type key = 0; key < kNumColdKeys; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  while (flashFairy.numEntriesLeftOnActivePage() > 0) {
+    ASSERT_TRUE(flashFairy.setValue(100, flashFairy.numEntriesLeftOnActivePage()));
+  }
+  EXPECT_EQ(statistics().numCompactions, 0);
+  RecordingTrace::events.clear();
+
+  ASSERT_TRUE(flashFairy.setValue(100, 0xBEEF));
+  EXPECT_EQ(statistics().numCompactions, 1);
+  EXPECT_EQ(statistics().numCopiedLines, kNumColdKeys);
+  EXPECT_EQ(statistics().numErases, 1);
+  EXPECT_EQ(statistics().numErasesPerPage[0], 1);
+  EXPECT_EQ(statistics().numErasesPerPage[1], 0);
+  EXPECT_EQ(flashFairy.countLiveKeys(), kNumColdKeys + 1);
+
+  // The page is erased once the new value is written.
+  using Event = RecordingTrace::Event;
+  const std::vector<Event>& events = RecordingTrace::events;
+  ASSERT_GE(events.size(), 4);
+  EXPECT_EQ(std::count(events.begin(), events.end(), Event::kCompactionBegin), 1);
+  EXPECT_EQ(std::count(events.begin(), events.end(), Event::kCompactionEnd), 1);
+  EXPECT_EQ(events.back(), Event::kErase);
+  EXPECT_EQ(events[events.size() - 2], Event::kProgram);
+  EXPECT_EQ(events[events.size() - 3], Event::kCompactionEnd);
+
+  // Counters start over on initialize().
+  CountingFlashFairy flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getStatistics().numErases, 0);
+  EXPECT_EQ(flashFairy2.getStatistics().numWrites, 0);
+}
+
+TEST_F(StatisticsFixture, ScannedLines) {
+  for (CountingFlashFairy::key_type key = 0; key < 10; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  const uint32_t scannedBefore = statistics().numScannedLines;
+
+  // Without a key index, the newest key is found after a single line, a missing key scans all lines.
+  EXPECT_EQ(flashFairy.getValue(9), 9);
+  EXPECT_EQ(statistics().numScannedLines, scannedBefore + 1);
+  EXPECT_EQ(flashFairy.getValue(50), FlashFairyPP::npos);
+  EXPECT_EQ(statistics().numScannedLines, scannedBefore + 1 + 10 + FlashFairyPP::kPageHeaderLines);
+}
+
+TEST_F(StatisticsFixture, LoadValues_SinglePass) {
+  for (CountingFlashFairy::key_type key = 0; key < 100; ++key) {
+    ASSERT_TRUE(flashFairy.setValue(key, key));
+  }
+  const uint32_t scannedBefore = statistics().numScannedLines;
+
+  CountingFlashFairy::value_type values[CountingFlashFairy::kNumKeys];
+  CountingFlashFairy::KeyBitmap_t present;
+  EXPECT_EQ(flashFairy.loadValues(values, present), 100);
+  EXPECT_EQ(statistics().numScannedLines, scannedBefore + 100 + CountingFlashFairy::kPageHeaderLines);
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,134 @@
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+using LargePages = BasicFlashFairyPP<Traits<2048, 64>>;
+using HugePages = BasicFlashFairyPP<Traits<4096, 32>>;
+using NarrowLines = BasicFlashFairyPP<Traits<512, 100, 8, 8>>;
+using WideValues = BasicFlashFairyPP<Traits<4096, 1000, 12, 20>>;
+using DoubleWord = BasicFlashFairyPP<DoubleWordTraits<2048, 200>>;
+
+struct CachedRingTraits : public Traits<> {
+  constexpr static const std::size_t kNumPages = 3;
+
+  template <typename Key, typename Value, std::size_t NumIndexedKeys, std::size_t NumPages, std::size_t LinesPerPage>
+  using KeyIndex = ValueCacheIndex<Key, Value, NumIndexedKeys, NumPages, LinesPerPage>;
+};
+using CachedRing = BasicFlashFairyPP<CachedRingTraits>;
+
+static_assert(std::is_same<NarrowLines::key_type, uint8_t>::value, "8 bit keys need a single byte");
+static_assert(std::is_same<NarrowLines::value_type, uint8_t>::value, "8 bit values need a single byte");
+static_assert(std::is_same<WideValues::value_type, uint32_t>::value, "20 bit values need four bytes");
+static_assert(WideValues::kValueMask == 0xFFFFF, "Value mask covers exactly the value bits");
+static_assert(std::is_same<DoubleWord::FlashLine_t, uint64_t>::value, "Double-word lines");
+static_assert(std::is_same<DoubleWord::value_type, uint32_t>::value, "Double-word lines hold 32 bit values");
+static_assert(sizeof(LargePages) == sizeof(FlashFairyPP), "Geometry does not grow the instance");
+static_assert(CachedRing::KeyIndex_t::kEnabled, "Traits select the key index");
+
+template <class FlashFairyT>
+class TraitsFixture : public BasicVirtualFlashFixture<FlashFairyT> {
+ public:
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  constexpr static std::size_t linesPerPage() {
+    return FlashFairyT::Config_t::pageSize / sizeof(typename FlashFairyT::FlashLine_t) - FlashFairyT::kPageHeaderLines;
+  }
+
+  /// A value that uses the upper bits of the value range.
+  static value_type makeValue(std::size_t i) {
+    return static_cast<value_type>((i * 0x9E37u) & FlashFairyT::kValueMask);
+  }
+};
+
+using TraitsTypes = ::testing::Types<LargePages, HugePages, NarrowLines, WideValues, CachedRing, DoubleWord>;
+TYPED_TEST_SUITE(TraitsFixture, TraitsTypes);
+
+TYPED_TEST(TraitsFixture, Read_Empty) {
+  EXPECT_EQ(this->flashFairy.getValue(0), TypeParam::npos);
+  EXPECT_EQ(this->flashFairy.numEntriesLeftOnActivePage(), this->linesPerPage());
+}
+
+TYPED_TEST(TraitsFixture, Write_AllKeys_Reset_Load) {
+  for (std::size_t key = 0; key < TypeParam::kNumKeys; ++key) {
+    ASSERT_TRUE(this->flashFairy.setValue(static_cast<typename TestFixture::key_type>(key), this->makeValue(key)));
+  }
+  EXPECT_FALSE(this->flashFairy.setValue(static_cast<typename TestFixture::key_type>(TypeParam::kNumKeys), 0));
+
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  for (std::size_t key = 0; key < TypeParam::kNumKeys; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(static_cast<typename TestFixture::key_type>(key)), this->makeValue(key));
+  }
+}
+
+TYPED_TEST(TraitsFixture, WriteSecondPage) {
+  constexpr static const std::size_t kNumHotKeys = 16;
+  const std::size_t numWrites = this->linesPerPage() * 3 + 5;
+  for (std::size_t i = 0; i < numWrites; ++i) {
+    ASSERT_TRUE(this->flashFairy.setValue(static_cast<typename TestFixture::key_type>(i % kNumHotKeys),
+                                          this->makeValue(i + 1)));
+  }
+
+  for (std::size_t i = numWrites - kNumHotKeys; i < numWrites; ++i) {
+    EXPECT_EQ(this->flashFairy.getValue(static_cast<typename TestFixture::key_type>(i % kNumHotKeys)),
+              this->makeValue(i + 1));
+  }
+  EXPECT_FALSE(eraseCounts.empty());
+
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), this->flashFairy.numEntriesLeftOnActivePage());
+  for (std::size_t key = 0; key < kNumHotKeys; ++key) {
+    EXPECT_EQ(flashFairy2.getValue(static_cast<typename TestFixture::key_type>(key)),
+              this->flashFairy.getValue(static_cast<typename TestFixture::key_type>(key)));
+  }
+}
+
+TYPED_TEST(TraitsFixture, Batch_Write) {
+  typename TypeParam::template WriteBatch<4> batch;
+  batch.setValue(1, this->makeValue(1));
+  batch.setValue(2, this->makeValue(2));
+  EXPECT_TRUE(this->flashFairy.setValues(batch));
+
+  TypeParam flashFairy2;
+  flashFairy2.initialize(this->config);
+  EXPECT_EQ(flashFairy2.getValue(1), this->makeValue(1));
+  EXPECT_EQ(flashFairy2.getValue(2), this->makeValue(2));
+  EXPECT_EQ(flashFairy2.numEntriesLeftOnActivePage(), this->linesPerPage() - 4);
+}
+
+using DoubleWordFixture = BasicVirtualFlashFixture<DoubleWord>;
+
+TEST_F(DoubleWordFixture, LineLayout) {
+  constexpr static const std::size_t kDataLines = 2048 / 8 - DoubleWord::kPageHeaderLines;
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines);
+  EXPECT_TRUE(flashFairy.setValue(199, 0xDEADBEEF));
+  EXPECT_EQ(flashFairy.getValue(199), 0xDEADBEEF);
+
+  uint64_t* lines = reinterpret_cast<uint64_t*>(pages[0]) + DoubleWord::kPageHeaderLines;
+  EXPECT_EQ(lines[0], 0x000000C7DEADBEEF);
+  EXPECT_EQ(lines[1], 0xFFFFFFFFFFFFFFFF);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 1);
+}
+
+TEST_F(DoubleWordFixture, Record) {
+  // Seven payload bytes per double-word.
+  EXPECT_TRUE(DoubleWord::kRecordsSupported);
+  const char text[] = "a record of more than one double-word";
+  EXPECT_TRUE(flashFairy.setRecord(3, text, sizeof(text)));
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(),
+            2048 / 8 - DoubleWord::kPageHeaderLines - (sizeof(text) + 6) / 7 - 1);
+
+  DoubleWord flashFairy2;
+  flashFairy2.initialize(config);
+  char readBack[sizeof(text)] = {};
+  std::size_t recordSize = 0;
+  EXPECT_TRUE(flashFairy2.getRecord(3, readBack, sizeof(readBack), &recordSize));
+  EXPECT_EQ(recordSize, sizeof(text));
+  EXPECT_STREQ(readBack, text);
+}
+
+}  // namespace FlashFairyPP
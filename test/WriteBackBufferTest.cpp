@@ -0,0 +1,105 @@
+#include "FlashFairyPP/WriteBackBuffer.h"
+#include "Mocks.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace FlashFairyPP {
+
+constexpr static const std::size_t kDataLines = 256 - FlashFairyPP::kPageHeaderLines;
+
+using Buffer = WriteBackBuffer<FlashFairyPP, 4>;
+
+TEST_F(VirtualFlashFixture, WriteBack_Coalesces) {
+  Buffer buffer(flashFairy);
+  for (FlashFairyPP::value_type i = 0; i < 100; ++i) {
+    ASSERT_TRUE(buffer.setValue(1, i));
+    ASSERT_TRUE(buffer.setValue(2, static_cast<FlashFairyPP::value_type>(i * 2)));
+  }
+  EXPECT_EQ(buffer.numDirty(), 2);
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines);
+
+  // Reads see buffered values, the store does not.
+  EXPECT_EQ(buffer.getValue(1), 99);
+  EXPECT_EQ(buffer.getValue(2), 198);
+  EXPECT_EQ(buffer.getValue(3), FlashFairyPP::npos);
+  EXPECT_EQ(flashFairy.getValue(1), FlashFairyPP::npos);
+
+  // Both keys and the batch markers.
+  EXPECT_TRUE(buffer.flush());
+  EXPECT_FALSE(buffer.isDirty());
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 4);
+  EXPECT_TRUE(buffer.flush());
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), kDataLines - 4);
+
+  FlashFairyPP flashFairy2;
+  flashFairy2.initialize(config);
+  EXPECT_EQ(flashFairy2.getValue(1), 99);
+  EXPECT_EQ(flashFairy2.getValue(2), 198);
+}
+
+TEST_F(VirtualFlashFixture, WriteBack_ReadsFallBackToFlash) {
+  ASSERT_TRUE(flashFairy.setValue(5, 50));
+  Buffer buffer(flashFairy);
+  FlashFairyPP::value_type value = 0;
+  EXPECT_TRUE(buffer.readValueIfAvailable(5, value));
+  EXPECT_EQ(value, 50);
+  ASSERT_TRUE(buffer.setValue(5, 51));
+  EXPECT_TRUE(buffer.readValueIfAvailable(5, value));
+  EXPECT_EQ(value, 51);
+
+  // Unchanged values are not written again.
+  ASSERT_TRUE(buffer.setValue(5, 50));
+  const std::size_t entriesLeft = flashFairy.numEntriesLeftOnActivePage();
+  EXPECT_TRUE(buffer.flush());
+  EXPECT_EQ(flashFairy.numEntriesLeftOnActivePage(), entriesLeft);
+
+  EXPECT_FALSE(buffer.setValue(static_cast<FlashFairyPP::key_type>(FlashFairyPP::kNumKeys), 0));
+  EXPECT_FALSE(buffer.isDirty());
+}
+
+TEST_F(VirtualFlashFixture, WriteBack_Threshold) {
+  Buffer buffer(flashFairy, 2);
+  ASSERT_TRUE(buffer.setValue(1, 10));
+  ASSERT_TRUE(buffer.setValue(1, 11));
+  EXPECT_EQ(buffer.numDirty(), 1);
+  ASSERT_TRUE(buffer.setValue(2, 20));
+  EXPECT_FALSE(buffer.isDirty());
+  EXPECT_EQ(flashFairy.getValue(1), 11);
+  EXPECT_EQ(flashFairy.getValue(2), 20);
+
+  // Without a threshold below the capacity, a full buffer is flushed before the next key is added.
+  buffer.setFlushThreshold(Buffer::kCapacity + 1);
+  for (FlashFairyPP::key_type key = 10; key < 10 + Buffer::kCapacity; ++key) {
+    ASSERT_TRUE(buffer.setValue(key, key));
+  }
+  EXPECT_EQ(buffer.numDirty(), Buffer::kCapacity);
+  ASSERT_TRUE(buffer.setValue(10, 100));
+  EXPECT_EQ(buffer.numDirty(), Buffer::kCapacity);
+  ASSERT_TRUE(buffer.setValue(20, 200));
+  EXPECT_EQ(buffer.numDirty(), 1);
+  EXPECT_EQ(flashFairy.getValue(10), 100);
+  EXPECT_EQ(flashFairy.getValue(20), FlashFairyPP::npos);
+  EXPECT_EQ(buffer.getValue(20), 200);
+}
+
+TEST_F(VirtualFlashFixture, WriteBack_BrownOut) {
+  Buffer buffer(flashFairy);
+  ASSERT_TRUE(buffer.setValue(7, 70));
+  void (*callback)(void*) = &Buffer::brownOutCallback;
+  callback(&buffer);
+  EXPECT_FALSE(buffer.isDirty());
+  EXPECT_EQ(flashFairy.getValue(7), 70);
+}
+
+TEST_F(VirtualFlashFixture, WriteBack_ManyPages) {
+  Buffer buffer(flashFairy);
+  for (std::size_t i = 0; i < kDataLines * 20; ++i) {
+    ASSERT_TRUE(buffer.setValue(static_cast<FlashFairyPP::key_type>(i % 6), static_cast<FlashFairyPP::value_type>(i)));
+  }
+  ASSERT_TRUE(buffer.flush());
+  for (std::size_t i = kDataLines * 20 - 6; i < kDataLines * 20; ++i) {
+    EXPECT_EQ(flashFairy.getValue(static_cast<FlashFairyPP::key_type>(i % 6)), i);
+  }
+}
+
+}  // namespace FlashFairyPP
@@ -0,0 +1,335 @@
+/*
+ * Host tool for FlashFairyPP flash images, e.g., to provision devices or to analyze dumps of returned units.
+ *
+ * An image is a raw copy of the flash pages of a store, page after page, in the order of Config_t::pages. The number
+ * of pages follows from the image size. Images use the default Traits apart from the page size.
+ *
+ * Usage: FlashFairyImage [--page-size BYTES] COMMAND ARGS...
+ *
+ *   create IMAGE NUM_PAGES [KEY=VALUE...]  Create an erased image and store the values.
+ *   set IMAGE KEY=VALUE...                  Store the values in an image, in batches of up to 32 values.
+ *   dump IMAGE...                           Print the pages, live values, records and stale entries of each image.
+ *   compact IMAGE...                        Rewrite each image with only its live values and records.
+ *
+ * Each batch of set is committed as a whole. More than 32 values are split into several batches, so an interrupted
+ * set may store only the first batches. Keys and values are decimal or 0x-prefixed hexadecimal. Images are mapped by
+ * MmapFlashFile; dump maps them copy-on-write and prints the page headers before initialize() recovers an interrupted
+ * page switch in memory, so it neither modifies an image nor hides its raw state.
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "FlashFairyPP/FlashFairyPP.h"
+#include "FlashFairyPP/MmapFlashHal.h"
+
+namespace FlashFairyPP {
+namespace {
+
+template <std::size_t PageSize, std::size_t NumPages>
+struct ImageTraits : public Traits<PageSize> {
+  constexpr static const std::size_t kNumPages = NumPages;
+  using FlashHal = MmapFlashHal<>;
+};
+
+constexpr static const std::size_t kMinPages = 2;
+constexpr static const std::size_t kMaxPages = 8;
+
+/// Parse a decimal or 0x-prefixed hexadecimal number no larger than max that ends at terminator. A leading 0 does
+/// not select octal.
+bool parseNumber(const char* text, const unsigned long max, unsigned long& number, const char terminator = '\0') {
+  const bool hexadecimal = text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+  const char* digits = hexadecimal ? text + 2 : text;
+  const unsigned char first = static_cast<unsigned char>(digits[0]);
+  if (!(hexadecimal ? isxdigit(first) : isdigit(first))) {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  number = strtoul(digits, &end, hexadecimal ? 16 : 10);
+  return *end == terminator && errno == 0 && number <= max;
+}
+
+/**
+ * \brief The commands on a store of NumPages pages of PageSize bytes.
+ */
+template <std::size_t PageSize, std::size_t NumPages>
+class ImageTool {
+ public:
+  using FlashFairyT = BasicFlashFairyPP<ImageTraits<PageSize, NumPages>>;
+  using key_type = typename FlashFairyT::key_type;
+  using value_type = typename FlashFairyT::value_type;
+
+  /// Batches of set(), see the usage above.
+  constexpr static const std::size_t kBatchSize = 32;
+
+  explicit ImageTool(MmapFlashFile& image) {
+    MmapFlashHal<>::file = &image;
+    for (std::size_t i = 0; i < NumPages; ++i) {
+      config_.pages[i] = reinterpret_cast<typename FlashFairyT::PagePtr_t>(image.page(i));
+    }
+  }
+
+  ~ImageTool() { MmapFlashHal<>::file = nullptr; }
+
+  /// Store KEY=VALUE arguments in batches of kBatchSize values, each of which is committed as a whole.
+  bool set(const char* path, char** edits, const int numEdits) {
+    // All edits are checked before the image is mounted, so an invalid edit leaves the image as it was.
+    std::vector<std::pair<key_type, value_type>> values;
+    for (int i = 0; i < numEdits; ++i) {
+      unsigned long key = 0;
+      unsigned long value = 0;
+      const char* separator = strchr(edits[i], '=');
+      if (separator == nullptr || !parseNumber(edits[i], FlashFairyT::kNumKeys - 1, key, '=') ||
+          !parseNumber(separator + 1, FlashFairyT::kValueMask, value)) {
+        fprintf(stderr, "%s: invalid edit '%s', expected KEY=VALUE\n", path, edits[i]);
+        return false;
+      }
+      values.emplace_back(static_cast<key_type>(key), static_cast<value_type>(value));
+    }
+
+    flashFairy_.initialize(config_);
+    typename FlashFairyT::template WriteBatch<kBatchSize> batch;
+    for (const auto& entry : values) {
+      batch.setValue(entry.first, entry.second);
+      if (batch.size() == kBatchSize && !storeBatch(path, batch)) {
+        return false;
+      }
+    }
+    return storeBatch(path, batch);
+  }
+
+  /// Print the raw page headers, then the entries that initialize() finds.
+  void dump(const char* path) {
+    printf("%s: %zu pages of %zu bytes\n", path, NumPages, PageSize);
+    for (std::size_t i = 0; i < NumPages; ++i) {
+      const uint32_t beginLine = config_.pages[i][0];
+      if (beginLine == FlashFairyT::kFreePattern) {
+        printf("  page %zu: erased\n", i);
+      } else if ((beginLine >> FlashFairyT::kValueBits) == FlashFairyT::kPageBeginKey) {
+        printf("  page %zu: generation %u\n", i, static_cast<unsigned>(beginLine & FlashFairyT::kValueMask));
+      } else {
+        printf("  page %zu: no header\n", i);
+      }
+    }
+
+    flashFairy_.initialize(config_);
+    std::vector<std::pair<key_type, value_type>> values;
+    for (const auto& entry : flashFairy_.liveEntries()) {
+      values.push_back(entry);
+    }
+    std::sort(values.begin(), values.end());
+    std::size_t numValueLines = 0;
+    const auto countValueLines = [&numValueLines](key_type, value_type) { ++numValueLines; };
+    flashFairy_.visitEntries(countValueLines);
+    const std::size_t numRecords = flashFairy_.countLiveKeys() - values.size();
+
+    printf("  live values: %zu, live records: %zu, stale values: %zu, free lines on active page: %zu\n", values.size(),
+           numRecords, numValueLines - values.size(), flashFairy_.numEntriesLeftOnActivePage());
+    for (const auto& entry : values) {
+      printf("  0x%04x = 0x%04x\n", static_cast<unsigned>(entry.first), static_cast<unsigned>(entry.second));
+    }
+    if (numRecords > 0) {
+      forEachRecord([](const key_type key, const uint8_t*, const std::size_t size) {
+        printf("  0x%04x : record of %zu bytes\n", static_cast<unsigned>(key), size);
+      });
+    }
+  }
+
+  /// Rewrite the image with the live values and records, following the page selection of initialize().
+  bool compact(const char* path) {
+    flashFairy_.initialize(config_);
+    std::vector<std::pair<key_type, value_type>> values;
+    for (const auto& entry : flashFairy_.liveEntries()) {
+      values.push_back(entry);
+    }
+    std::vector<std::pair<key_type, std::vector<uint8_t>>> records;
+    forEachRecord([&records](const key_type key, const uint8_t* data, const std::size_t size) {
+      records.emplace_back(key, std::vector<uint8_t>(data, data + size));
+    });
+
+    flashFairy_.formatFlash();
+    for (const auto& record : records) {
+      if (!flashFairy_.setRecord(record.first, record.second.data(), record.second.size())) {
+        fprintf(stderr, "%s: record 0x%04x does not fit\n", path, static_cast<unsigned>(record.first));
+        return false;
+      }
+    }
+    // Oldest first, so values keep their relative age.
+    for (auto it = values.rbegin(); it != values.rend(); ++it) {
+      if (!flashFairy_.setValue(it->first, it->second)) {
+        fprintf(stderr, "%s: value 0x%04x does not fit\n", path, static_cast<unsigned>(it->first));
+        return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  template <std::size_t Capacity>
+  bool storeBatch(const char* path, typename FlashFairyT::template WriteBatch<Capacity>& batch) {
+    if (!flashFairy_.setValues(batch)) {
+      fprintf(stderr, "%s: batch of %zu values does not fit\n", path, batch.size());
+      return false;
+    }
+    batch.clear();
+    return true;
+  }
+
+  /// Call visitor(key, data, size) for every key that holds a record.
+  template <class Visitor>
+  void forEachRecord(Visitor visitor) const {
+    uint8_t buffer[FlashFairyT::kMaxRecordSize];
+    for (std::size_t key = 0; key < FlashFairyT::kNumKeys; ++key) {
+      std::size_t size = 0;
+      if (flashFairy_.getRecord(static_cast<key_type>(key), buffer, sizeof(buffer), &size)) {
+        visitor(static_cast<key_type>(key), buffer, size);
+      }
+    }
+  }
+
+  typename FlashFairyT::Config_t config_;
+  FlashFairyT flashFairy_;
+};
+
+enum class Command { kCreate, kSet, kDump, kCompact };
+
+template <std::size_t PageSize, std::size_t NumPages>
+bool runOnImage(const Command command, const char* path, MmapFlashFile& image, char** edits, const int numEdits) {
+  ImageTool<PageSize, NumPages> tool(image);
+  switch (command) {
+    case Command::kCreate:
+    case Command::kSet:
+      return tool.set(path, edits, numEdits);
+    case Command::kDump:
+      tool.dump(path);
+      return true;
+    case Command::kCompact:
+      return tool.compact(path);
+  }
+  return false;
+}
+
+/// Select the store type for the number of pages of an image.
+template <std::size_t PageSize, std::size_t NumPages = kMinPages>
+struct PageCountDispatch {
+  static bool run(const std::size_t numPages, const Command command, const char* path, MmapFlashFile& image,
+                  char** edits, const int numEdits) {
+    if (numPages == NumPages) {
+      return runOnImage<PageSize, NumPages>(command, path, image, edits, numEdits);
+    }
+    return PageCountDispatch<PageSize, NumPages + 1>::run(numPages, command, path, image, edits, numEdits);
+  }
+};
+
+template <std::size_t PageSize>
+struct PageCountDispatch<PageSize, kMaxPages + 1> {
+  static bool run(std::size_t, Command, const char*, MmapFlashFile&, char**, int) { return false; }
+};
+
+bool runOnImage(const std::size_t pageSize, const Command command, const char* path, MmapFlashFile& image,
+                char** edits, const int numEdits) {
+  const std::size_t numPages = image.numPages();
+  if (numPages < kMinPages || numPages > kMaxPages) {
+    fprintf(stderr, "%s: %zu pages, expected %zu to %zu pages of %zu bytes\n", path, numPages, kMinPages, kMaxPages,
+            pageSize);
+    return false;
+  }
+  switch (pageSize) {
+    case 1024:
+      return PageCountDispatch<1024>::run(numPages, command, path, image, edits, numEdits);
+    case 2048:
+      return PageCountDispatch<2048>::run(numPages, command, path, image, edits, numEdits);
+    case 4096:
+      return PageCountDispatch<4096>::run(numPages, command, path, image, edits, numEdits);
+    default:
+      fprintf(stderr, "Unsupported page size %zu, use 1024, 2048 or 4096\n", pageSize);
+      return false;
+  }
+}
+
+/// Map an image, of numPages pages or, if numPages is 0, of all pages of the file.
+bool openImage(MmapFlashFile& image, const char* path, const std::size_t pageSize, const std::size_t numPages,
+               const MmapFlashFile::Access access) {
+  if (!image.open(path, pageSize, numPages, access)) {
+    fprintf(stderr, "%s: cannot map image of %zu byte pages: %s\n", path, pageSize, strerror(image.getLastError()));
+    return false;
+  }
+  return true;
+}
+
+int usage() {
+  fprintf(stderr,
+          "Usage: FlashFairyImage [--page-size BYTES] COMMAND ARGS...\n"
+          "  create IMAGE NUM_PAGES [KEY=VALUE...]\n"
+          "  set IMAGE KEY=VALUE...\n"
+          "  dump IMAGE...\n"
+          "  compact IMAGE...\n");
+  return 2;
+}
+
+}  // namespace
+}  // namespace FlashFairyPP
+
+int main(int argc, char** argv) {
+  using namespace FlashFairyPP;
+  std::size_t pageSize = 1024;
+  int arg = 1;
+  if (arg + 1 < argc && strcmp(argv[arg], "--page-size") == 0) {
+    unsigned long number = 0;
+    if (!parseNumber(argv[arg + 1], 0x10000, number)) {
+      return usage();
+    }
+    pageSize = number;
+    arg += 2;
+  }
+  if (arg + 1 >= argc) {
+    return usage();
+  }
+  const char* commandName = argv[arg++];
+
+  if (strcmp(commandName, "create") == 0 || strcmp(commandName, "set") == 0) {
+    const bool create = commandName[0] == 'c';
+    const char* path = argv[arg++];
+    unsigned long numPages = 0;
+    if (create && (arg >= argc || !parseNumber(argv[arg++], kMaxPages, numPages) || numPages < kMinPages)) {
+      return usage();
+    }
+    // create replaces an existing image.
+    FILE* truncated = create ? fopen(path, "wb") : nullptr;
+    if (truncated != nullptr) {
+      fclose(truncated);
+    }
+    MmapFlashFile image;
+    if (!openImage(image, path, pageSize, numPages, MmapFlashFile::Access::kReadWrite)) {
+      return 1;
+    }
+    return runOnImage(pageSize, create ? Command::kCreate : Command::kSet, path, image, argv + arg, argc - arg) ? 0 : 1;
+  }
+
+  Command command;
+  if (strcmp(commandName, "dump") == 0) {
+    command = Command::kDump;
+  } else if (strcmp(commandName, "compact") == 0) {
+    command = Command::kCompact;
+  } else {
+    return usage();
+  }
+  int result = 0;
+  for (; arg < argc; ++arg) {
+    MmapFlashFile image;
+    const auto access = (command == Command::kCompact) ? MmapFlashFile::Access::kReadWrite
+                                                       : MmapFlashFile::Access::kPrivate;
+    if (!openImage(image, argv[arg], pageSize, 0, access) ||
+        !runOnImage(pageSize, command, argv[arg], image, nullptr, 0)) {
+      result = 1;
+    }
+  }
+  return result;
+}